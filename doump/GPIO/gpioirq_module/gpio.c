@@ -19,10 +19,7 @@ int main(int argc, char** argv)
 	// Write to GPIO
     write(fd, argv[1], strlen(argv[1]), NULL);
 
-	// Read from Kernel (출력모드로 설정되어 있기에 Kernel로부터 읽는다.)
-    read(fd, buf, strlen(argv[1]), NULL);
-
-	printf("Read data : %s\n", buf);
+	// read() 는 스위치 edge 이벤트를 돌려준다 (irq_event 참고).
     close(fd);
 
     return 0;
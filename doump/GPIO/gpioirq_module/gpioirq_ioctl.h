@@ -0,0 +1,38 @@
+#ifndef GPIOIRQ_IOCTL_H
+#define GPIOIRQ_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+//===============================================
+// gpioirq_module 과 유저 프로그램이 함께 쓰는 정의
+// /dev/gpioled (major 200) 을 read() 하면 gpioirq_event 가 여러 개 한 번에 온다.
+//===============================================
+
+#define GPIOIRQ_EDGE_FALLING    0
+#define GPIOIRQ_EDGE_RISING     1
+
+struct gpioirq_event {
+    __u64 ts_ns;                        // ISR 에서 찍은 ktime_get_ns() (CLOCK_MONOTONIC)
+    __u32 seq;                          // 모든 핀에 걸친 순번. 건너뛴 번호는 놓친 이벤트
+    __u16 pin;                          // BCM GPIO 번호
+    __u8  edge;                         // GPIOIRQ_EDGE_*
+    __u8  pad;
+};
+
+// 스위치 핀 하나의 debounce 설정과 통계
+struct gpioirq_debounce {
+    __u16 pin;                          // GPIO_START(17) / GPIO_STOP(18)
+    __u8  hw;                           // 1 = 컨트롤러가 거른다 (걸러진 edge 는 suppressed 에 안 잡힌다)
+    __u8  pad;
+    __u32 window_us;                    // 0 = 끔
+    __u64 accepted;                     // 이벤트로 받아들인 edge
+    __u64 suppressed;                   // 튐으로 버린 edge
+};
+
+#define GPIOIRQ_IOC_MAGIC       'g'
+#define GPIOIRQ_IOC_OVERRUN     _IOR(GPIOIRQ_IOC_MAGIC, 1, __u32)   // 링이 차서 버린 이벤트 수 (읽으면 0)
+#define GPIOIRQ_IOC_DEBOUNCE    _IOWR(GPIOIRQ_IOC_MAGIC, 2, struct gpioirq_debounce)   // pin 을 채워 부르면 나머지를 채운다
+#define GPIOIRQ_IOC_SET_DEBOUNCE _IOW(GPIOIRQ_IOC_MAGIC, 3, struct gpioirq_debounce)   // pin, window_us 만 본다
+
+#endif
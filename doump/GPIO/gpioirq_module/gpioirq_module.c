@@ -5,6 +5,24 @@
 #include <linux/gpio.h>
 #include <asm/uaccess.h>
 #include <linux/interrupt.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/gpio/consumer.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/types.h>
+#endif
+
+#include "gpioirq_ioctl.h"
 
 
 #define BCM_IO_BASE         0x3F000000                   // RaspberryPi 2,3 I/O Peripherals Base 
@@ -25,11 +43,15 @@
 #define GPIO_START 		  17 
 #define GPIO_STOP  	      18
 
+#define EVENT_RING          256         // 파일마다 쌓아 두는 이벤트 수 (2의 거듭제곱)
+
 static char msg[BLOCK_SIZE] = {0};
 
 static int gpio_open(struct inode *, struct file *);
 static ssize_t gpio_read(struct file *, char *, size_t, loff_t *);
 static ssize_t gpio_write(struct file *, const char *, size_t, loff_t *);
+static unsigned int gpio_poll(struct file *, poll_table *);
+static long gpio_ioctl(struct file *, unsigned int, unsigned long);
 static int gpio_close(struct inode *, struct file *);
 
 /* 유닉스 입출력 함수들의 처리를 위한 구조체 */
@@ -37,15 +59,81 @@ static struct file_operations gpio_fops = {
    .owner   = THIS_MODULE,
    .read    = gpio_read,
    .write   = gpio_write,
+   .poll    = gpio_poll,
+   .unlocked_ioctl = gpio_ioctl,
    .open    = gpio_open,
    .release = gpio_close,
 };
 
+//===============================================
+// edge 이벤트 링
+// ISR 이 열린 파일마다 (pin, edge, 시각, 순번)을 kfifo 에 넣는다.
+// 넣는 쪽은 readers_lock 으로 직렬화하고, 꺼내는 쪽은 그 파일의 read() 하나라
+// kfifo 를 잠금 없이 읽는다. 링이 차면 새 이벤트를 버리고 overrun 을 센다.
+//===============================================
+struct gpio_reader {
+    struct list_head list;
+    DECLARE_KFIFO(fifo, struct gpioirq_event, EVENT_RING);
+    struct mutex read_lock;             // 같은 파일에 read() 가 동시에 들어오는 경우
+    u32 overrun;
+};
+
+static LIST_HEAD(readers);
+static DEFINE_SPINLOCK(readers_lock);
+static DECLARE_WAIT_QUEUE_HEAD(event_wq);
+static u32 event_seq;
+
 struct cdev gpio_cdev;   
 // static int switch_irq;
+
+//===============================================
+// 스위치 IRQ
+// hard IRQ(top half)는 시각과 핀 레벨만 stamps 에 넣고 깨운다.
+// 이벤트 기록과 LED 처리는 IRQ 스레드에서 하며, 스레드의 우선순위와 CPU 는 모듈 인자로 정한다.
+//===============================================
+static int irq_prio = 0;
+module_param(irq_prio, int, 0444);
+MODULE_PARM_DESC(irq_prio, "SCHED_FIFO priority of the switch IRQ threads (1-99, 0 = kernel default)");
+
+static int irq_cpu = -1;
+module_param(irq_cpu, int, 0444);
+MODULE_PARM_DESC(irq_cpu, "CPU for the switch IRQs and their threads (-1 = any)");
+
+static uint debounce_us = 10000;
+module_param(debounce_us, uint, 0444);
+MODULE_PARM_DESC(debounce_us, "Initial debounce window of each switch pin in us (0 = off)");
+
+struct edge_stamp {
+    u64 ts;                             // 이벤트로 알리는 edge 시각 (debounce 면 창의 첫 edge)
+    u64 wake_ts;                        // 스레드를 깨운 시각. 지연(lat_max)은 여기서부터 잰다.
+    int level;
+};
+
+struct switch_irq {
+    int irq;
+    int pin;
+    DECLARE_KFIFO(stamps, struct edge_stamp, EVENT_RING);   // top half -> 스레드
+    atomic_t dropped;                   // stamps 가 차서 버린 edge (top half, 타이머, 스레드)
+    u64 lat_max;                        // edge 에서 스레드가 처리할 때까지 최대 지연 (ns)
+    bool rt;                            // 스레드에 irq_prio 를 적용했는지
+    int rt_err;                         // 적용 결과
+    struct completion rt_done;          // init 이 적용을 기다린다
+
+    // debounce: 컨트롤러가 못 거르면 마지막 edge 뒤 window 동안 조용할 때 레벨을 한 번 본다.
+    spinlock_t lock;                    // top half 와 debounce 타이머 사이
+    struct hrtimer deb_timer;
+    u32 window_us;                      // 0 = 끔
+    bool hw;                            // gpiod_set_debounce() 로 컨트롤러가 거른다
+    int stable;                         // 마지막으로 받아들인 레벨
+    int edges;                          // 창 안에서 본 edge 수
+    u64 first_ts;                       // 창의 첫 edge 시각
+    u64 accepted;
+    u64 suppressed;
+};
+
 // 각각의 핸들러 번호를 등록하는 변수를 생성
-static int on_irq;
-static int off_irq;
+static struct switch_irq start_sw = { .pin = GPIO_START };
+static struct switch_irq stop_sw  = { .pin = GPIO_STOP };
 
 // Interrupt 
  /*
@@ -61,23 +149,212 @@ static irqreturn_t isr_func(int irq, void *data)
 }
  */
 
-// Start switch Interrupt function
+// lost 는 이 이벤트 앞에서 top half 가 버린 edge 수
+static void event_push(int pin, int edge, u64 ts, u32 lost)
+{
+    struct gpioirq_event ev;
+    struct gpio_reader *r;
+    unsigned long flags;
+
+    ev.ts_ns = ts;
+    ev.pin = pin;
+    ev.edge = edge;
+    ev.pad = 0;
+
+    spin_lock_irqsave(&readers_lock, flags);
+    event_seq += lost;
+    ev.seq = event_seq++;
+    list_for_each_entry(r, &readers, list) {
+        r->overrun += lost;
+        if (!kfifo_put(&r->fifo, ev))
+            r->overrun++;
+    }
+    spin_unlock_irqrestore(&readers_lock, flags);
+    wake_up_interruptible(&event_wq);
+}
+
+// IRQ 스레드에 irq_prio 를 적용한다. init 이 irq_wake_thread() 로 한 번 깨워 첫 edge 전에 부르고
+// rt_done 으로 결과를 기다린다.
+// 5.9 부터 sched_setscheduler_nocheck() 가 export 되지 않아 sched_setattr_nocheck() 를 쓴다.
+static void irq_thread_rt(struct switch_irq *sw)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    struct sched_attr attr = {
+        .size           = sizeof(attr),
+        .sched_policy   = SCHED_FIFO,
+        .sched_priority = irq_prio,
+    };
+#else
+    struct sched_param param = { .sched_priority = irq_prio };
+#endif
+
+    if (sw->rt || irq_prio <= 0)
+        return;
+    sw->rt = true;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    sw->rt_err = sched_setattr_nocheck(current, &attr);
+#else
+    sw->rt_err = sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+#endif
+    complete(&sw->rt_done);
+}
+
+// IRQ 스레드를 깨워 irq_prio 를 적용시키고 결과를 돌려준다. stamps 가 비어 있으므로 스레드는 다른 일을 하지 않는다.
+static int irq_thread_prime(struct switch_irq *sw)
+{
+    if (irq_prio <= 0)
+        return 0;
+    irq_wake_thread(sw->irq, sw);
+    if (!wait_for_completion_timeout(&sw->rt_done, HZ)) {
+        printk(KERN_ERR "switch %d : IRQ thread did not run\n", sw->pin);
+        return -ETIMEDOUT;
+    }
+    if (sw->rt_err)
+        printk(KERN_ERR "switch %d : SCHED_FIFO %d failed (%d)\n", sw->pin, irq_prio, sw->rt_err);
+    return sw->rt_err;
+}
+
+// IRQ 를 irq_cpu 로 보낸다. IRQ 스레드도 IRQ 의 affinity 를 따라간다. mask 가 NULL 이면 hint 만 지운다.
+static void irq_pin_cpu(int irq, const struct cpumask *mask)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+    irq_set_affinity_and_hint(irq, mask);
+#else
+    irq_set_affinity_hint(irq, mask);
+#endif
+}
+
+// top half: 시각과 레벨만 남기고 스레드를 깨운다. stamps 에 넣는 쪽은 top half 나
+// debounce 타이머 중 하나뿐이고 꺼내는 쪽은 그 IRQ 의 스레드 하나라 잠금 없이 쓴다.
+// 소프트웨어 debounce 중이면 창만 다시 시작하고 판단은 타이머에 맡긴다.
+static irqreturn_t isr_top(int irq, void *data)
+{
+    struct switch_irq *sw = data;
+    struct edge_stamp st;
+    unsigned long flags;
+
+    st.ts = ktime_get_ns();
+    if (sw->window_us && !sw->hw) {
+        spin_lock_irqsave(&sw->lock, flags);
+        if (sw->edges++ == 0)
+            sw->first_ts = st.ts;
+        hrtimer_start(&sw->deb_timer, ns_to_ktime((u64)sw->window_us * 1000), HRTIMER_MODE_REL);
+        spin_unlock_irqrestore(&sw->lock, flags);
+        return IRQ_HANDLED;
+    }
+
+    st.wake_ts = st.ts;
+    st.level = gpio_get_value(sw->pin);
+    sw->stable = st.level;
+    sw->accepted++;
+    if (!kfifo_put(&sw->stamps, st))
+        atomic_inc(&sw->dropped);
+    return IRQ_WAKE_THREAD;
+}
+
+// 창 동안 edge 가 없었다. 레벨이 바뀌었으면 첫 edge 시각으로 한 번만 받아들이고
+// 나머지 edge 는 suppressed 로 센다. 제자리로 돌아왔으면 모두 글리치다.
+// 스레드 지연은 창 길이가 섞이지 않도록 여기서 깨우는 시각부터 잰다.
+static enum hrtimer_restart debounce_func(struct hrtimer *t)
+{
+    struct switch_irq *sw = container_of(t, struct switch_irq, deb_timer);
+    struct edge_stamp st;
+    unsigned long flags;
+    int edges;
+
+    spin_lock_irqsave(&sw->lock, flags);
+    st.ts = sw->first_ts;
+    edges = sw->edges;
+    sw->edges = 0;
+    spin_unlock_irqrestore(&sw->lock, flags);
+
+    st.level = gpio_get_value(sw->pin);
+    if (st.level == sw->stable) {
+        sw->suppressed += edges;
+        return HRTIMER_NORESTART;
+    }
+    sw->stable = st.level;
+    sw->accepted++;
+    sw->suppressed += edges - 1;
+    st.wake_ts = ktime_get_ns();
+    if (!kfifo_put(&sw->stamps, st))
+        atomic_inc(&sw->dropped);
+    irq_wake_thread(sw->irq, sw);
+    return HRTIMER_NORESTART;
+}
+
+// 컨트롤러 debounce 를 먼저 시도하고, 안 되면 hrtimer 창을 쓴다. IRQ 가 꺼진 상태에서 부른다.
+static void debounce_setup(struct switch_irq *sw, u32 us)
+{
+    int ret;
+
+    hrtimer_cancel(&sw->deb_timer);
+    ret = gpiod_set_debounce(gpio_to_desc(sw->pin), us);
+    sw->window_us = us;
+    sw->hw = us && ret == 0;
+    sw->edges = 0;
+    sw->stable = gpio_get_value(sw->pin);
+}
+
+static struct switch_irq *switch_by_pin(int pin)
+{
+    if (pin == GPIO_START)
+        return &start_sw;
+    if (pin == GPIO_STOP)
+        return &stop_sw;
+    return NULL;
+}
+
+// Start/stop switch Interrupt function (IRQ 스레드)
+// 양쪽 edge 를 모두 받아 이벤트로 남기고, LED 는 누를 때(rising)만 바꾼다.
+// edge 마다 printk 를 하면 초당 수백 번에서 막히므로 하지 않는다.
 static irqreturn_t isr_func(int irq, void* data)
 {
-    if(irq == on_irq && !gpio_get_value(GPIO_LED)) {
-        gpio_set_value(GPIO_LED, 1);
-    } else if(irq == off_irq && gpio_get_value(GPIO_LED)) {
-        gpio_set_value(GPIO_LED, 0);
+    struct switch_irq *sw = data;
+    struct edge_stamp st;
+    u64 lat;
+    u32 lost;
+
+    irq_thread_rt(sw);
+    while (kfifo_get(&sw->stamps, &st)) {
+        lat = ktime_get_ns() - st.wake_ts;
+        if (lat > sw->lat_max)
+            sw->lat_max = lat;
+        lost = atomic_xchg(&sw->dropped, 0);
+        event_push(sw->pin, st.level ? GPIOIRQ_EDGE_RISING : GPIOIRQ_EDGE_FALLING, st.ts, lost);
+        if (!st.level)
+            continue;
+
+        if(sw == &start_sw && !gpio_get_value(GPIO_LED)) {
+            gpio_set_value(GPIO_LED, 1);
+        } else if(sw == &stop_sw && gpio_get_value(GPIO_LED)) {
+            gpio_set_value(GPIO_LED, 0);
+        }
     }
-    printk("GPIO Interrupt!!\n");
     return IRQ_HANDLED;
 }
 
 
 static int gpio_open(struct inode *inod, struct file *fil)
 {
+    struct gpio_reader *r;
+    unsigned long flags;
+
     printk("GPIO Device opened(%d:%d)\n", imajor(inod), iminor(inod));
 
+    //===========================================================
+    // 파일마다 이벤트 링을 만들어 ISR 이 채우는 목록에 건다.
+    //===========================================================
+    r = kzalloc(sizeof(*r), GFP_KERNEL);
+    if (!r)
+        return -ENOMEM;
+    INIT_KFIFO(r->fifo);
+    mutex_init(&r->read_lock);
+    spin_lock_irqsave(&readers_lock, flags);
+    list_add_tail(&r->list, &readers);
+    spin_unlock_irqrestore(&readers_lock, flags);
+    fil->private_data = r;
+
     //===========================================================
     // 모듈 사용 횟수 카운트 
     // 모듈을 여러곳에서 동시에 사용하고 있는 경우 사용 횟수 카운트를 증가 시킨다.
@@ -89,8 +366,16 @@ static int gpio_open(struct inode *inod, struct file *fil)
 
 static int gpio_close(struct inode *inod, struct file *fil)
 {
+    struct gpio_reader *r = fil->private_data;
+    unsigned long flags;
+
     printk("GPIO Device closed(%d:%d)\n", imajor(inod), iminor(inod));
 
+    spin_lock_irqsave(&readers_lock, flags);
+    list_del(&r->list);
+    spin_unlock_irqrestore(&readers_lock, flags);
+    kfree(r);
+
     //===========================================================
     // 모듈 사용 횟수 카운트 
     // 모듈을 여러곳에서 동시에 사용하고 있는 경우 사용 횟수 카운트를 증가 시킨다.
@@ -99,18 +384,80 @@ static int gpio_close(struct inode *inod, struct file *fil)
     return 0;
 }
 
-static ssize_t gpio_read(struct file *inode, char *buff, size_t len, loff_t *off)
+//===========================================================
+// 쌓인 이벤트를 struct gpioirq_event 단위로 len 이 허락하는 만큼 한 번에 보낸다.
+// 비어 있으면 O_NONBLOCK 이 아닌 한 다음 edge 까지 기다린다.
+//===========================================================
+static ssize_t gpio_read(struct file *fil, char *buff, size_t len, loff_t *off)
 {
-    int count;
-    strcat(msg, " from Kernel");
+    struct gpio_reader *r = fil->private_data;
+    unsigned int copied;
+    int ret;
+
+    if (len < sizeof(struct gpioirq_event))
+        return -EINVAL;
+    len -= len % sizeof(struct gpioirq_event);
+
+    if (kfifo_is_empty(&r->fifo)) {
+        if (fil->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(event_wq, !kfifo_is_empty(&r->fifo));
+        if (ret)
+            return ret;
+    }
 
-    //===========================================================
-    // 유저 영역으로 데이터를 보낸다 
-    //===========================================================
-    count = copy_to_user(buff, msg, strlen(msg)+1);     
- 
-    printk("GPIO Device read : %s(%d)\n", msg, count);
-    return count;
+    if (mutex_lock_interruptible(&r->read_lock))
+        return -ERESTARTSYS;
+    ret = kfifo_to_user(&r->fifo, (char __user *)buff, len, &copied);
+    mutex_unlock(&r->read_lock);
+    return ret ? ret : copied;
+}
+
+static unsigned int gpio_poll(struct file *fil, poll_table *wait)
+{
+    struct gpio_reader *r = fil->private_data;
+
+    poll_wait(fil, &event_wq, wait);
+    return kfifo_is_empty(&r->fifo) ? 0 : POLLIN | POLLRDNORM;
+}
+
+static long gpio_ioctl(struct file *fil, unsigned int cmd, unsigned long arg)
+{
+    struct gpio_reader *r = fil->private_data;
+    struct gpioirq_debounce deb;
+    struct switch_irq *sw;
+    unsigned long flags;
+    u32 overrun;
+
+    switch (cmd) {
+    case GPIOIRQ_IOC_OVERRUN:
+        spin_lock_irqsave(&readers_lock, flags);
+        overrun = r->overrun;
+        r->overrun = 0;
+        spin_unlock_irqrestore(&readers_lock, flags);
+        return put_user(overrun, (u32 __user *)arg);
+
+    case GPIOIRQ_IOC_DEBOUNCE:
+    case GPIOIRQ_IOC_SET_DEBOUNCE:
+        if (copy_from_user(&deb, (void __user *)arg, sizeof(deb)))
+            return -EFAULT;
+        sw = switch_by_pin(deb.pin);
+        if (!sw)
+            return -EINVAL;
+        if (cmd == GPIOIRQ_IOC_SET_DEBOUNCE) {
+            disable_irq(sw->irq);
+            debounce_setup(sw, deb.window_us);
+            enable_irq(sw->irq);
+            return 0;
+        }
+        deb.hw = sw->hw;
+        deb.pad = 0;
+        deb.window_us = sw->window_us;
+        deb.accepted = sw->accepted;
+        deb.suppressed = sw->suppressed;
+        return copy_to_user((void __user *)arg, &deb, sizeof(deb)) ? -EFAULT : 0;
+    }
+    return -ENOTTY;
 }
 
 static ssize_t gpio_write(struct file *inode, const char *buff, size_t len, loff_t *off)
@@ -148,6 +495,11 @@ int GPIO_init(void)
     //===========================================================
     printk(KERN_INFO "GPIO_init!\n");
 
+    if (irq_prio < 0 || irq_prio > MAX_RT_PRIO - 1) {
+        printk(KERN_ERR "irq_prio %d : must be 0-%d\n", irq_prio, MAX_RT_PRIO - 1);
+        return -EINVAL;
+    }
+
     //===========================================================
     // major와 minor를 전달하고 디바이스 파일의 번호를 받는다.
     // Major 200, Minor 199의 경우 devNo=0x0c8000c7이다. 
@@ -197,16 +549,71 @@ int GPIO_init(void)
 
     // GPIO 핀 IRQ 등록 
     //switch_irq = gpio_to_irq(GPIO_SW);
-    on_irq  = gpio_to_irq(GPIO_START);
-    off_irq   = gpio_to_irq(GPIO_STOP);
+    start_sw.irq = gpio_to_irq(GPIO_START);
+    stop_sw.irq  = gpio_to_irq(GPIO_STOP);
+    INIT_KFIFO(start_sw.stamps);
+    INIT_KFIFO(stop_sw.stamps);
+    spin_lock_init(&start_sw.lock);
+    spin_lock_init(&stop_sw.lock);
+    init_completion(&start_sw.rt_done);
+    init_completion(&stop_sw.rt_done);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&start_sw.deb_timer, debounce_func, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    hrtimer_setup(&stop_sw.deb_timer, debounce_func, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&start_sw.deb_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    hrtimer_init(&stop_sw.deb_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    start_sw.deb_timer.function = debounce_func;
+    stop_sw.deb_timer.function = debounce_func;
+#endif
+    debounce_setup(&start_sw, debounce_us);
+    debounce_setup(&stop_sw, debounce_us);
 
     // GPIO IRQ Handler 등록 
     //request_irq(switch_irq, isr_func, IRQF_TRIGGER_RISING | IRQF_DISABLED, "switch", NULL);
 	//request_irq(switch_irq, isr_func, IRQF_TRIGGER_RISING, "switch", NULL);
-	request_irq(on_irq, isr_func, IRQF_TRIGGER_RISING, "switch start", NULL);
-	request_irq(off_irq , isr_func, IRQF_TRIGGER_RISING, "switch stop", NULL);
+	err = request_threaded_irq(start_sw.irq, isr_top, isr_func, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "switch start", &start_sw);
+    if (err < 0) {
+        printk("Error : start switch IRQ %d (%d)\n", start_sw.irq, err);
+        goto err_start;
+    }
+	err = request_threaded_irq(stop_sw.irq, isr_top, isr_func, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "switch stop", &stop_sw);
+    if (err < 0) {
+        printk("Error : stop switch IRQ %d (%d)\n", stop_sw.irq, err);
+        goto err_stop;
+    }
+    if (irq_cpu >= 0 && irq_cpu < nr_cpu_ids && cpu_online(irq_cpu)) {
+        irq_pin_cpu(start_sw.irq, cpumask_of(irq_cpu));
+        irq_pin_cpu(stop_sw.irq, cpumask_of(irq_cpu));
+    }
+    err = irq_thread_prime(&start_sw);
+    if (!err)
+        err = irq_thread_prime(&stop_sw);
+    if (err)
+        goto err_prio;
 
 	return 0;
+
+    //===========================================================
+    // 실패하면 잡은 순서의 반대로 풀고 로드를 실패시킨다.
+    // IRQ 를 먼저 풀어야 debounce 타이머가 다시 걸리지 않는다.
+    //===========================================================
+err_prio:
+    irq_pin_cpu(start_sw.irq, NULL);
+    irq_pin_cpu(stop_sw.irq, NULL);
+    free_irq(stop_sw.irq, &stop_sw);
+err_stop:
+    free_irq(start_sw.irq, &start_sw);
+err_start:
+    hrtimer_cancel(&start_sw.deb_timer);
+    hrtimer_cancel(&stop_sw.deb_timer);
+    gpio_free(GPIO_LED);
+    gpio_free(GPIO_SW);
+    gpio_free(GPIO_START);
+    gpio_free(GPIO_STOP);
+    cdev_del(&gpio_cdev);
+    unregister_chrdev_region(devno, 1);
+    return err;
 }
 
 void GPIO_exit(void)
@@ -227,8 +634,20 @@ void GPIO_exit(void)
     // 사용이 끝난 인터럽트 해제
     //===========================================================    
     //free_irq(switch_irq, NULL);
-    free_irq(on_irq, NULL);
-    free_irq(off_irq, NULL);
+    // 타이머가 IRQ 스레드를 깨우지 않도록 IRQ 를 막고 타이머를 먼저 지운다.
+    disable_irq(start_sw.irq);
+    disable_irq(stop_sw.irq);
+    hrtimer_cancel(&start_sw.deb_timer);
+    hrtimer_cancel(&stop_sw.deb_timer);
+    irq_pin_cpu(start_sw.irq, NULL);
+    irq_pin_cpu(stop_sw.irq, NULL);
+    free_irq(start_sw.irq, &start_sw);
+    free_irq(stop_sw.irq, &stop_sw);
+    printk(KERN_INFO "switch irq latency max : start %llu ns, stop %llu ns\n",
+           (unsigned long long)start_sw.lat_max, (unsigned long long)stop_sw.lat_max);
+    printk(KERN_INFO "switch edges accepted/suppressed : start %llu/%llu, stop %llu/%llu\n",
+           (unsigned long long)start_sw.accepted, (unsigned long long)start_sw.suppressed,
+           (unsigned long long)stop_sw.accepted, (unsigned long long)stop_sw.suppressed);
 
     //===========================================================   
     // 더 이상 사용이 필요없는 경우 관련 자원을 해제한다.
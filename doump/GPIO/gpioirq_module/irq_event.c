@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+#include "gpioirq_ioctl.h"
+
+#define EVENT_BATCH 64
+
+static const int pins[] = { 17, 18 };   // GPIO_START, GPIO_STOP
+
+// 사용법: ./irq_event [debounce_us]
+// 스위치 edge 를 epoll 로 기다렸다가 read() 한 번에 모아 읽고 출력한다.
+// debounce_us 를 주면 두 스위치의 debounce 창을 먼저 바꾼다.
+int main(int argc, char** argv)
+{
+    struct gpioirq_event ev[EVENT_BATCH];
+    struct gpioirq_debounce deb;
+    struct epoll_event pev;
+    __u32 overrun, next = 0;
+    int fd, epfd, i, n, first = 1;
+
+    fd = open("/dev/gpioled", O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        printf("can not open /dev/gpioled\n");
+        return -1;
+    }
+    for (i = 0; argc > 1 && i < 2; i++) {
+        deb.pin = pins[i];
+        deb.window_us = atoi(argv[1]);
+        if (ioctl(fd, GPIOIRQ_IOC_SET_DEBOUNCE, &deb) < 0)
+            printf("Failed to set debounce of pin %d\n", pins[i]);
+    }
+    epfd = epoll_create1(0);
+    pev.events = EPOLLIN;
+    pev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &pev);
+
+    while (epoll_wait(epfd, &pev, 1, -1) >= 0) {
+        n = read(fd, ev, sizeof(ev));
+        if (n <= 0)
+            continue;
+        for (i = 0; i < n / (int)sizeof(ev[0]); i++) {
+            if (!first && ev[i].seq != next)
+                printf("missed %u events\n", ev[i].seq - next);
+            printf("seq %u pin %u %s %llu.%09llu\n", ev[i].seq, ev[i].pin,
+                   ev[i].edge == GPIOIRQ_EDGE_RISING ? "rising " : "falling",
+                   (unsigned long long)ev[i].ts_ns / 1000000000ULL,
+                   (unsigned long long)ev[i].ts_ns % 1000000000ULL);
+            next = ev[i].seq + 1;
+            first = 0;
+        }
+        if (ioctl(fd, GPIOIRQ_IOC_OVERRUN, &overrun) == 0 && overrun)
+            printf("overrun %u\n", overrun);
+        for (i = 0; i < 2; i++) {
+            deb.pin = pins[i];
+            if (ioctl(fd, GPIOIRQ_IOC_DEBOUNCE, &deb) == 0)
+                printf("pin %d debounce %uus%s : accepted %llu, suppressed %llu\n", pins[i], deb.window_us,
+                       deb.hw ? " (hw)" : "", (unsigned long long)deb.accepted, (unsigned long long)deb.suppressed);
+        }
+    }
+    close(epfd);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef GPIOSIGNAL_IOCTL_H
+#define GPIOSIGNAL_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+//===============================================
+// gpiosignal_module 과 유저 프로그램이 함께 쓰는 ioctl 정의 (/dev/gpioled)
+//===============================================
+
+// 스위치 핀 하나의 debounce 설정과 통계
+struct gpiosignal_debounce {
+    __u16 pin;                          // GPIO_SW1(24) / GPIO_SW2(25)
+    __u8  hw;                           // 1 = 컨트롤러가 거른다 (걸러진 edge 는 suppressed 에 안 잡힌다)
+    __u8  pad;
+    __u32 window_us;                    // 0 = 끔
+    __u64 accepted;                     // 시그널을 보낸 누름
+    __u64 suppressed;                   // 튐으로 버린 edge
+    __u64 last_ns;                      // 마지막으로 받아들인 누름의 edge 시각 (CLOCK_MONOTONIC)
+};
+
+#define GPIOSIGNAL_IOC_MAGIC        's'
+#define GPIOSIGNAL_IOC_DEBOUNCE     _IOWR(GPIOSIGNAL_IOC_MAGIC, 1, struct gpiosignal_debounce)  // pin 을 채워 부르면 나머지를 채운다
+#define GPIOSIGNAL_IOC_SET_DEBOUNCE _IOW(GPIOSIGNAL_IOC_MAGIC, 2, struct gpiosignal_debounce)   // pin, window_us 만 본다
+
+#endif
@@ -10,6 +10,29 @@
 #include <linux/sched.h>
 #include <linux/signal.h>
 #include <asm/siginfo.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/gpio/consumer.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/types.h>
+#endif
+
+#include "gpiosignal_ioctl.h"
+
+/* 4.20 부터 send_sig_info() 는 struct kernel_siginfo 를 받는다. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+typedef struct kernel_siginfo gpio_siginfo_t;
+#else
+typedef struct siginfo gpio_siginfo_t;
+#endif
+
+/* 6.2 에서 del_timer_sync() 가 timer_delete_sync() 로 바뀌었다. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 2, 0)
+#define timer_delete_sync del_timer_sync
+#endif
 
 #define BCM_IO_BASE         0x3F000000                   // RaspberryPi 2,3 I/O Peripherals Base 
 #define GPIO_BASE           (BCM_IO_BASE + 0x200000)     // GPIO Register Base 
@@ -29,6 +52,7 @@ static char msg[BLOCK_SIZE] = {0};                      /* write( ) 함수에서
 static int gpio_open(struct inode *, struct file *);
 static ssize_t gpio_read(struct file *, char *, size_t, loff_t *);
 static ssize_t gpio_write(struct file *, const char *, size_t, loff_t *);
+static long gpio_ioctl(struct file *, unsigned int, unsigned long);
 static int gpio_close(struct inode *, struct file *);
 
 static int pwm_val;
@@ -47,35 +71,195 @@ struct cdev gpio_cdev;
 static int switch_pwmp_irq ;
 static int switch_pwmm_irq;
 static struct timer_list timer;              /* 타이머 처리를 위한 구조체 */
+static int timer_led;                        /* 타이머가 다음에 쓸 LED 상태 */
 static struct task_struct *task;                     /* 태스크를 위한 구조체 */
 
-/* 타이머 처리를 위한 함수 */
+//===============================================
+// 스위치 IRQ
+// hard IRQ(top half)는 시각만 찍고, LED 처리와 시그널 전송은 IRQ 스레드에서 한다.
+// send_sig_info() 는 대상 태스크의 잠금을 잡으므로 hard IRQ 에 두지 않는다.
+// 스레드의 우선순위와 CPU 는 모듈 인자로 정한다.
+//===============================================
+static int irq_prio = 0;
+module_param(irq_prio, int, 0444);
+MODULE_PARM_DESC(irq_prio, "SCHED_FIFO priority of the switch IRQ threads (1-99, 0 = kernel default)");
+
+static int irq_cpu = -1;
+module_param(irq_cpu, int, 0444);
+MODULE_PARM_DESC(irq_cpu, "CPU for the switch IRQs and their threads (-1 = any)");
+
+static uint debounce_us = 10000;
+module_param(debounce_us, uint, 0444);
+MODULE_PARM_DESC(debounce_us, "Initial debounce window of each switch pin in us (0 = off)");
+
+struct switch_irq {
+    int irq;
+    int pin;
+    u64 ts;                             // 마지막으로 받아들인 누름의 edge 시각 (debounce 면 창의 첫 edge)
+    u64 wake_ts;                        // 스레드를 깨운 시각. 지연(lat_max)은 여기서부터 잰다.
+    u64 lat_max;                        // 스레드를 깨운 뒤 처리할 때까지 최대 지연 (ns)
+    bool rt;                            // 스레드에 irq_prio 를 적용했는지
+    int rt_err;                         // 적용 결과
+    struct completion rt_done;          // init 이 적용을 기다린다
+
+    // debounce: 컨트롤러가 못 거르면 마지막 edge 뒤 window 동안 조용할 때 레벨을 한 번 본다.
+    spinlock_t lock;                    // top half 와 debounce 타이머 사이
+    struct hrtimer deb_timer;
+    u32 window_us;                      // 0 = 끔
+    bool hw;                            // gpiod_set_debounce() 로 컨트롤러가 거른다
+    int edges;                          // 창 안에서 본 edge 수
+    u64 first_ts;                       // 창의 첫 edge 시각
+    u64 accepted;
+    u64 suppressed;
+};
+
+static struct switch_irq sw_on  = { .pin = GPIO_SW1 };
+static struct switch_irq sw_off = { .pin = GPIO_SW2 };
+
+/* 타이머 처리를 위한 함수 : 4.15 부터 timer_list 의 data 가 없어져 LED 상태는 timer_led 에 둔다. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+static void timer_func(struct timer_list *t)
+#else
 static void timer_func(unsigned long data)
+#endif
 {
-        gpio_set_value(GPIO_LED, data);      /* LED의 상태 설정 */
+        gpio_set_value(GPIO_LED, timer_led);               /* LED의 상태 설정 */
 
         /* 다음 실행을 위한 타이머 설정 */
-        timer.data = !data;                                /* LED의 상태를 토글 */  
-        timer.expires = jiffies + (1*HZ/100);              /* LED의 켜고 끄는 주기는 1초 */         
-        add_timer(&timer);                                 /* 타이머 추가 */         
+        timer_led = !timer_led;                            /* LED의 상태를 토글 */
+        mod_timer(&timer, jiffies + (1*HZ/100));           /* LED의 켜고 끄는 주기는 10ms */
+}
+
+// 깨운 뒤부터의 지연을 잰다. 처음 한 번은 init 이 irq_wake_thread() 로 깨운 것이므로
+// irq_prio 만 적용해 rt_done 으로 알리고 true 를 돌려준다. 이때 핸들러는 아무것도 하지 않는다.
+// 5.9 부터 sched_setscheduler_nocheck() 가 export 되지 않아 sched_setattr_nocheck() 를 쓴다.
+static bool irq_thread_enter(struct switch_irq *sw)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    struct sched_attr attr = {
+        .size           = sizeof(attr),
+        .sched_policy   = SCHED_FIFO,
+        .sched_priority = irq_prio,
+    };
+#else
+    struct sched_param param = { .sched_priority = irq_prio };
+#endif
+    u64 lat;
+
+    if (!sw->rt && irq_prio > 0) {
+        sw->rt = true;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+        sw->rt_err = sched_setattr_nocheck(current, &attr);
+#else
+        sw->rt_err = sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+#endif
+        complete(&sw->rt_done);
+        return true;
+    }
+    lat = ktime_get_ns() - READ_ONCE(sw->wake_ts);
+    if (lat > sw->lat_max)
+        sw->lat_max = lat;
+    return false;
+}
+
+// IRQ 스레드를 한 번 깨워 첫 edge 전에 irq_prio 를 적용시키고 결과를 돌려준다.
+static int irq_thread_prime(struct switch_irq *sw)
+{
+    if (irq_prio <= 0)
+        return 0;
+    irq_wake_thread(sw->irq, sw);
+    if (!wait_for_completion_timeout(&sw->rt_done, HZ)) {
+        printk(KERN_ERR "switch %d : IRQ thread did not run\n", sw->pin);
+        return -ETIMEDOUT;
+    }
+    if (sw->rt_err)
+        printk(KERN_ERR "switch %d : SCHED_FIFO %d failed (%d)\n", sw->pin, irq_prio, sw->rt_err);
+    return sw->rt_err;
+}
 
-		if(!gpio_get_value(GPIO_LED, data)){
-			gpio_set_value(GPIO_LED,data);
+// IRQ 를 irq_cpu 로 보낸다. IRQ 스레드도 IRQ 의 affinity 를 따라간다. mask 가 NULL 이면 hint 만 지운다.
+static void irq_pin_cpu(int irq, const struct cpumask *mask)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+    irq_set_affinity_and_hint(irq, mask);
+#else
+    irq_set_affinity_hint(irq, mask);
+#endif
+}
 
-			timer.data:
-		}
+/* top half : 시각만 찍고 스레드를 깨운다. 소프트웨어 debounce 중이면 창만 다시 시작한다. */
+static irqreturn_t isr_top(int irq, void *data)
+{
+    struct switch_irq *sw = data;
+    unsigned long flags;
+    u64 ts = ktime_get_ns();
+
+    if (sw->window_us && !sw->hw) {
+        spin_lock_irqsave(&sw->lock, flags);
+        if (sw->edges++ == 0)
+            sw->first_ts = ts;
+        hrtimer_start(&sw->deb_timer, ns_to_ktime((u64)sw->window_us * 1000), HRTIMER_MODE_REL);
+        spin_unlock_irqrestore(&sw->lock, flags);
+        return IRQ_HANDLED;
+    }
+    sw->ts = ts;
+    sw->wake_ts = ts;
+    sw->accepted++;
+    return IRQ_WAKE_THREAD;
+}
+
+// 창 동안 edge 가 없었다. 스위치가 눌린(low) 상태로 안정됐으면 누름 하나로 받아들이고
+// 나머지 edge 는 suppressed 로 센다. 떼는 순간의 튐은 high 로 끝나므로 모두 버린다.
+// 스레드 지연은 창 길이가 섞이지 않도록 여기서 깨우는 시각부터 잰다.
+static enum hrtimer_restart debounce_func(struct hrtimer *t)
+{
+    struct switch_irq *sw = container_of(t, struct switch_irq, deb_timer);
+    unsigned long flags;
+    int edges;
+    u64 ts;
+
+    spin_lock_irqsave(&sw->lock, flags);
+    ts = sw->first_ts;
+    edges = sw->edges;
+    sw->edges = 0;
+    spin_unlock_irqrestore(&sw->lock, flags);
+
+    if (gpio_get_value(sw->pin)) {
+        sw->suppressed += edges;
+        return HRTIMER_NORESTART;
+    }
+    sw->accepted++;
+    sw->suppressed += edges - 1;
+    WRITE_ONCE(sw->ts, ts);
+    WRITE_ONCE(sw->wake_ts, ktime_get_ns());
+    irq_wake_thread(sw->irq, sw);
+    return HRTIMER_NORESTART;
+}
+
+// 컨트롤러 debounce 를 먼저 시도하고, 안 되면 hrtimer 창을 쓴다. IRQ 가 꺼진 상태에서 부른다.
+static void debounce_setup(struct switch_irq *sw, u32 us)
+{
+    int ret;
+
+    hrtimer_cancel(&sw->deb_timer);
+    ret = gpiod_set_debounce(gpio_to_desc(sw->pin), us);
+    sw->window_us = us;
+    sw->hw = us && ret == 0;
+    sw->edges = 0;
 }
 
 // ============================================================================
-// 인터럽트 처리를 위한 인터럽트 서비스 루틴(Interrupt Service Routine)
+// 인터럽트 처리를 위한 인터럽트 서비스 루틴(Interrupt Service Routine) : IRQ 스레드
 // ============================================================================
 static irqreturn_t isr_off_func(int irq, void *data)
 {
+    if (irq_thread_enter(data))
+        return IRQ_HANDLED;
     if(irq == switch_pwmm_irq) {
         gpio_set_value(GPIO_LED, 1);
         /* 시그널 처리를 위한 구조체 등록 */
-        static struct siginfo sinfo;                        /* 시그널 처리를 위한 구조체 */
-        memset(&sinfo, 0, sizeof(struct siginfo));
+        gpio_siginfo_t sinfo;                               /* 시그널 처리를 위한 구조체 */
+        memset(&sinfo, 0, sizeof(sinfo));
         sinfo.si_signo = SIGUSR1;
         sinfo.si_code = SI_USER;
         send_sig_info(SIGUSR1, &sinfo, task);        /* 해당 프로세스에 시그널 보내기 */
@@ -88,11 +272,13 @@ static irqreturn_t isr_off_func(int irq, void *data)
 
 static irqreturn_t isr_on_func(int irq, void *data)
 {
+    if (irq_thread_enter(data))
+        return IRQ_HANDLED;
     if(irq ==switch_pwmp_irq  ) {
         gpio_set_value(GPIO_LED, 1);
         /* 시그널 처리를 위한 구조체 등록 */
-        static struct siginfo sinfo;                        /* 시그널 처리를 위한 구조체 */
-        memset(&sinfo, 0, sizeof(struct siginfo));
+        gpio_siginfo_t sinfo;                               /* 시그널 처리를 위한 구조체 */
+        memset(&sinfo, 0, sizeof(sinfo));
         sinfo.si_signo = SIGUSR2;
         sinfo.si_code = SI_USER;
         send_sig_info(SIGUSR2, &sinfo, task);        /* 해당 프로세스에 시그널 보내기 */
@@ -116,9 +302,32 @@ static int gpio_open(struct inode *inod, struct file *fil)
     return 0;
 }
 
-static int gpio_ioctl(struct inode *inode, struct file *filp, unsigned int cmd, unsigned long arg)
+static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
+    struct gpiosignal_debounce deb;
+    struct switch_irq *sw;
+
 	switch(cmd){
+		case GPIOSIGNAL_IOC_DEBOUNCE:
+		case GPIOSIGNAL_IOC_SET_DEBOUNCE:
+			if (copy_from_user(&deb, (void __user *)arg, sizeof(deb)))
+				return -EFAULT;
+			sw = deb.pin == GPIO_SW1 ? &sw_on : deb.pin == GPIO_SW2 ? &sw_off : NULL;
+			if (!sw)
+				return -EINVAL;
+			if (cmd == GPIOSIGNAL_IOC_SET_DEBOUNCE) {
+				disable_irq(sw->irq);
+				debounce_setup(sw, deb.window_us);
+				enable_irq(sw->irq);
+				return 0;
+			}
+			deb.hw = sw->hw;
+			deb.pad = 0;
+			deb.window_us = sw->window_us;
+			deb.accepted = sw->accepted;
+			deb.suppressed = sw->suppressed;
+			deb.last_ns = READ_ONCE(sw->ts);
+			return copy_to_user((void __user *)arg, &deb, sizeof(deb)) ? -EFAULT : 0;
 		case 0:
 			printk(" test : 1\n");
 			break;
@@ -132,8 +341,9 @@ static int gpio_ioctl(struct inode *inode, struct file *filp, unsigned int cmd,
 			printk(" test : 4\n");
 			break;
 		default:
-			break;
+			return -ENOTTY;
 	}
+	return 0;
 }
 
 static int gpio_close(struct inode *inod, struct file *fil)
@@ -194,16 +404,13 @@ static ssize_t gpio_write(struct file *inode, const char *buff, size_t len, loff
     // cmd가 "0"이 아닐 경우 타이머를 종료하고 gpio출력을 0으로 설정한다. 
     //===========================================================
     if(!strcmp(cmd, "0")) {
-        del_timer_sync(&timer);                       /* 타이머 삭제 */         
+        timer_delete_sync(&timer);                    /* 타이머 삭제 */
         gpio_set_value(GPIO_LED, 0);
     } else {
-        /* 타이머 초기화와 타이머 처리를 위한 함수 등록 */  
-        init_timer(&timer);
-        timer.function = timer_func; 
-        /* timer_list 구조체 초기화 : 기본값 LDE 켜기, 주기 1초 */  
-        timer.data = 1L;                                 
-        timer.expires = jiffies + (1*HZ / 100);
-        add_timer(&timer);                                /* 타이머 추가 */         
+        /* 타이머는 init 에서 준비했다. 기본값 LED 켜기, 주기 10ms */
+        timer_delete_sync(&timer);
+        timer_led = 1;
+        mod_timer(&timer, jiffies + (1*HZ / 100));        /* 타이머 추가 */
     }
 
     printk("GPIO Device write : %s(%d)\n", msg, len);
@@ -238,6 +445,20 @@ int GPIO_init(void)
     //===========================================================
     printk(KERN_INFO "GPIO initModule!\n");
 
+    if (irq_prio < 0 || irq_prio > MAX_RT_PRIO - 1) {
+        printk(KERN_ERR "irq_prio %d : must be 0-%d\n", irq_prio, MAX_RT_PRIO - 1);
+        return -EINVAL;
+    }
+
+    //===========================================================
+    // LED 토글 타이머 준비 : write() 에서 mod_timer() 로 시작한다.
+    //===========================================================
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+    timer_setup(&timer, timer_func, 0);
+#else
+    setup_timer(&timer, timer_func, 0);
+#endif
+
     //===========================================================
     // major와 minor를 전달하고 디바이스 파일의 번호를 받는다.
     // Major 200, Minor 199의 경우 devNo=0x0c8000c7이다. 
@@ -284,11 +505,67 @@ int GPIO_init(void)
     // GPIO 핀 IRQ 등록 
     switch_pwmp_irq = gpio_to_irq(GPIO_SW1);
     switch_pwmm_irq= gpio_to_irq(GPIO_SW2);
+    sw_on.irq = switch_pwmp_irq;
+    sw_off.irq = switch_pwmm_irq;
+
+    // 스위치 debounce : 컨트롤러가 지원하면 하드웨어, 아니면 hrtimer 창
+    spin_lock_init(&sw_on.lock);
+    spin_lock_init(&sw_off.lock);
+    init_completion(&sw_on.rt_done);
+    init_completion(&sw_off.rt_done);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&sw_on.deb_timer, debounce_func, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    hrtimer_setup(&sw_off.deb_timer, debounce_func, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+    hrtimer_init(&sw_on.deb_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    hrtimer_init(&sw_off.deb_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    sw_on.deb_timer.function = debounce_func;
+    sw_off.deb_timer.function = debounce_func;
+#endif
+    debounce_setup(&sw_on, debounce_us);
+    debounce_setup(&sw_off, debounce_us);
     //request_irq(switch_irq, isr_func, IRQF_TRIGGER_RISING | IRQF_DISABLED, "switch", NULL);
-    request_irq(switch_pwmp_irq, isr_on_func, IRQF_TRIGGER_FALLING, "switch on", NULL);
-    request_irq(switch_pwmm_irq, isr_off_func, IRQF_TRIGGER_FALLING, "switch off", NULL);
+    errNo = request_threaded_irq(switch_pwmp_irq, isr_top, isr_on_func, IRQF_TRIGGER_FALLING, "switch on", &sw_on);
+    if (errNo < 0) {
+        printk("Error : on switch IRQ %d (%d)\n", switch_pwmp_irq, errNo);
+        goto err_on;
+    }
+    errNo = request_threaded_irq(switch_pwmm_irq, isr_top, isr_off_func, IRQF_TRIGGER_FALLING, "switch off", &sw_off);
+    if (errNo < 0) {
+        printk("Error : off switch IRQ %d (%d)\n", switch_pwmm_irq, errNo);
+        goto err_off;
+    }
+    if (irq_cpu >= 0 && irq_cpu < nr_cpu_ids && cpu_online(irq_cpu)) {
+        irq_pin_cpu(switch_pwmp_irq, cpumask_of(irq_cpu));
+        irq_pin_cpu(switch_pwmm_irq, cpumask_of(irq_cpu));
+    }
+    errNo = irq_thread_prime(&sw_on);
+    if (!errNo)
+        errNo = irq_thread_prime(&sw_off);
+    if (errNo)
+        goto err_prio;
 
     return 0;
+
+    //===========================================================
+    // 실패하면 잡은 순서의 반대로 풀고 로드를 실패시킨다.
+    // IRQ 를 먼저 풀어야 debounce 타이머가 다시 걸리지 않는다.
+    //===========================================================
+err_prio:
+    irq_pin_cpu(switch_pwmp_irq, NULL);
+    irq_pin_cpu(switch_pwmm_irq, NULL);
+    free_irq(switch_pwmm_irq, &sw_off);
+err_off:
+    free_irq(switch_pwmp_irq, &sw_on);
+err_on:
+    hrtimer_cancel(&sw_on.deb_timer);
+    hrtimer_cancel(&sw_off.deb_timer);
+    gpio_free(GPIO_LED);
+    gpio_free(GPIO_SW1);
+    gpio_free(GPIO_SW2);
+    cdev_del(&gpio_cdev);
+    unregister_chrdev_region(devNo, 1);
+    return errNo;
 }
 
 
@@ -300,7 +577,7 @@ void GPIO_exit(void)
     //===========================================================
     // 등록 했던 타이머를 삭제해 준다. 
     //===========================================================
-    del_timer_sync(&timer);
+    timer_delete_sync(&timer);
 
     //===========================================================
     // 문자 디바이스의 등록을 해제한다.
@@ -315,8 +592,20 @@ void GPIO_exit(void)
     //===========================================================
     // 사용이 끝난 인터럽트 해제
     //=========================================================== 
-    free_irq(switch_pwmp_irq, NULL);
-    free_irq(switch_pwmm_irq, NULL);
+    // 타이머가 IRQ 스레드를 깨우지 않도록 IRQ 를 막고 타이머를 먼저 지운다.
+    disable_irq(switch_pwmp_irq);
+    disable_irq(switch_pwmm_irq);
+    hrtimer_cancel(&sw_on.deb_timer);
+    hrtimer_cancel(&sw_off.deb_timer);
+    irq_pin_cpu(switch_pwmp_irq, NULL);
+    irq_pin_cpu(switch_pwmm_irq, NULL);
+    free_irq(switch_pwmp_irq, &sw_on);
+    free_irq(switch_pwmm_irq, &sw_off);
+    printk(KERN_INFO "switch irq latency max : on %llu ns, off %llu ns\n",
+           (unsigned long long)sw_on.lat_max, (unsigned long long)sw_off.lat_max);
+    printk(KERN_INFO "switch presses accepted/suppressed : on %llu/%llu, off %llu/%llu\n",
+           (unsigned long long)sw_on.accepted, (unsigned long long)sw_on.suppressed,
+           (unsigned long long)sw_off.accepted, (unsigned long long)sw_off.suppressed);
 
     //===========================================================   
     // 더 이상 사용이 필요없는 경우 관련 자원을 해제한다.
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+#include "gpiotimer_ioctl.h"
+
+// 사용법: ./bulk set_mask clear_mask [count]
+// bank 0 핀을 ioctl 한 번에 바꾼다. count 를 주면 두 mask 를 번갈아 count 번 보낸다.
+int main(int argc, char** argv)
+{
+    struct gpiotimer_bulk bulk;
+    __u32 set, clr;
+    int fd, i, count = 1;
+
+    if (argc < 3) {
+        printf("Usage : %s set_mask clear_mask [count]\n", argv[0]);
+        return -1;
+    }
+    set = strtoul(argv[1], NULL, 0);
+    clr = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        count = atoi(argv[3]);
+
+    fd = open("/dev/gpioled", O_RDWR);
+    if (fd < 0) {
+        printf("can not open /dev/gpioled\n");
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        bulk.set_mask = i & 1 ? clr : set;
+        bulk.clear_mask = i & 1 ? set : clr;
+        if (ioctl(fd, GPIOTIMER_IOC_BULK, &bulk) < 0) {
+            printf("Failed to write pins 0x%08x/0x%08x\n", bulk.set_mask, bulk.clear_mask);
+            break;
+        }
+    }
+    close(fd);
+    return 0;
+}
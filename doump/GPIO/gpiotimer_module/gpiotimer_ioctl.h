@@ -0,0 +1,37 @@
+#ifndef GPIOTIMER_IOCTL_H
+#define GPIOTIMER_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+//===============================================
+// gpiotimer_module 과 유저 프로그램이 함께 쓰는 ioctl 정의 (/dev/gpioled)
+//===============================================
+
+#define GPIOTIMER_PWM_MAX       8       // 동시에 돌릴 수 있는 PWM 핀 수
+#define GPIOTIMER_PWM_MIN_US    20      // 이보다 짧은 주기는 받지 않는다
+
+// 소프트웨어 PWM 채널 하나
+// period_us == 0 이면 채널을 끄고 핀을 low 로 둔다.
+// duty_us == 0 / duty_us >= period_us 이면 타이머 없이 low / high 로 고정한다.
+struct gpiotimer_pwm {
+    __u16 pin;
+    __u16 pad;
+    __u32 period_us;
+    __u32 duty_us;
+    __u32 late;                         // 늦게 깨어 주기를 다시 맞춘 횟수 (GET 만)
+};
+
+// bank 0 (GPIO 0 ~ 31) 핀을 한 번에 바꾼다. bit n = GPIO n
+// 처음 쓰는 핀은 출력으로 잡고, 같은 핀이 두 mask 에 다 있으면 EINVAL
+struct gpiotimer_bulk {
+    __u32 set_mask;
+    __u32 clear_mask;
+};
+
+#define GPIOTIMER_IOC_MAGIC     't'
+#define GPIOTIMER_IOC_SET_PWM   _IOW(GPIOTIMER_IOC_MAGIC, 1, struct gpiotimer_pwm)
+#define GPIOTIMER_IOC_GET_PWM   _IOWR(GPIOTIMER_IOC_MAGIC, 2, struct gpiotimer_pwm)   // pin 을 채워 부른다
+#define GPIOTIMER_IOC_BULK      _IOW(GPIOTIMER_IOC_MAGIC, 3, struct gpiotimer_bulk)
+
+#endif
@@ -5,12 +5,27 @@
 #include <linux/gpio.h>
 #include <asm/uaccess.h>
 #include <linux/interrupt.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/types.h>
+#endif
+
+#include "gpiotimer_ioctl.h"
 
 
 #define BCM_IO_BASE         0x3F000000                   // RaspberryPi 2,3 I/O Peripherals Base 
 #define GPIO_BASE           (BCM_IO_BASE + 0x200000)     // GPIO Register Base 
 #define GPIO_SIZE           0xB4                         // 0x7E200000 – 0x7E20000B3  
+#define GPSET0              0x1C                         // 1 을 쓴 핀만 high
+#define GPCLR0              0x28                         // 1 을 쓴 핀만 low
+#define GPLEV0              0x34                         // 핀 레벨
 
 #define GPIO_MAJOR 		    200
 #define GPIO_MINOR 		    0
@@ -24,6 +39,7 @@ static char msg[BLOCK_SIZE] = {0};                      // write( ) 함수에서
 static int gpio_open(struct inode *, struct file *);
 static ssize_t gpio_read(struct file *, char *, size_t, loff_t *);
 static ssize_t gpio_write(struct file *, const char *, size_t, loff_t *);
+static long gpio_ioctl(struct file *, unsigned int, unsigned long);
 static int gpio_close(struct inode *, struct file *);
 
 /* 유닉스 입출력 함수들의 처리를 위한 구조체 */
@@ -31,28 +47,338 @@ static struct file_operations gpio_fops = {
    .owner = THIS_MODULE,
    .read = gpio_read,
    .write = gpio_write,
+   .unlocked_ioctl = gpio_ioctl,
    .open = gpio_open,
    .release = gpio_close,
 };
 
 struct cdev gpio_cdev;   
 static int switch_irq;
-static struct timer_list timer;              /* 타이머 처리를 위한 구조체 */
 
-/* 타이머 처리를 위한 함수 */
-static void timer_func(unsigned long data)
+//===============================================
+// 여러 핀을 한 번에 바꾸는 레지스터 경로
+// GPSET0/GPCLR0 는 1 인 bit 만 바꾸므로 읽고-고쳐-쓰기 없이 store 한 번이면 된다.
+// 매핑이 맞는지 확인되지 않으면 gpio_set_value() 로 핀마다 바꾼다.
+//===============================================
+static ulong gpio_base = GPIO_BASE;
+module_param(gpio_base, ulong, 0444);
+MODULE_PARM_DESC(gpio_base, "Physical address of the GPIO registers (0x3F200000 Pi 2/3, 0xFE200000 Pi 4)");
+
+static void __iomem *gpio_map;
+static u32 bulk_pins;                   // GPIOTIMER_IOC_BULK 용으로 잡은 핀
+
+static void gpio_write_masks(u32 set, u32 clr)
+{
+    int pin;
+
+    if (gpio_map) {
+        if (set)
+            writel(set, gpio_map + GPSET0);
+        if (clr)
+            writel(clr, gpio_map + GPCLR0);
+        return;
+    }
+    for (pin = 0; pin < 32; pin++)
+        if ((set | clr) & BIT(pin))
+            gpio_set_value(pin, !!(set & BIT(pin)));
+}
+
+// gpio_base 에 정말 이 보드의 GPIO 가 있는지 GPIO_LED 를 올렸다 내려 GPLEV0 로 확인한다.
+static void gpio_map_probe(void)
+{
+    bool ok;
+
+    gpio_map = ioremap(gpio_base, GPIO_SIZE);
+    if (!gpio_map)
+        return;
+    gpio_set_value(GPIO_LED, 1);
+    ok = readl(gpio_map + GPLEV0) & BIT(GPIO_LED);
+    gpio_set_value(GPIO_LED, 0);
+    ok = ok && !(readl(gpio_map + GPLEV0) & BIT(GPIO_LED));
+    if (!ok) {
+        printk(KERN_INFO "no GPIO registers at 0x%lx, falling back to gpiolib\n", gpio_base);
+        iounmap(gpio_map);
+        gpio_map = NULL;
+    }
+}
+
+//===============================================
+// 스위치 IRQ
+// hard IRQ(top half)는 시각만 찍고, LED 처리는 IRQ 스레드에서 한다.
+// 스레드의 우선순위와 CPU 는 모듈 인자로 정한다.
+//===============================================
+static int irq_prio = 0;
+module_param(irq_prio, int, 0444);
+MODULE_PARM_DESC(irq_prio, "SCHED_FIFO priority of the switch IRQ thread (1-99, 0 = kernel default)");
+
+static int irq_cpu = -1;
+module_param(irq_cpu, int, 0444);
+MODULE_PARM_DESC(irq_cpu, "CPU for the switch IRQ and its thread (-1 = any)");
+
+static u64 switch_ts;                   // top half 에서 찍은 마지막 edge 시각
+static u64 switch_lat_max;              // edge 에서 스레드가 처리할 때까지 최대 지연 (ns)
+static bool switch_rt;                  // 스레드에 irq_prio 를 적용했는지
+static int switch_rt_err;               // 적용 결과
+static DECLARE_COMPLETION(switch_rt_done);  // init 이 적용을 기다린다
+
+//===============================================
+// 소프트웨어 PWM
+// hrtimer 하나가 모든 핀을 돌린다. 채널은 다음 edge 시각 순으로 정렬해 두고,
+// 타이머가 깨면 지난 edge 를 모두 처리한 뒤 맨 앞 채널의 edge 에 다시 맞춘다.
+//===============================================
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+#define PWM_TIMER_MODE  HRTIMER_MODE_ABS_HARD   // PREEMPT_RT 에서도 hard IRQ 에서 돈다
+#else
+#define PWM_TIMER_MODE  HRTIMER_MODE_ABS
+#endif
+
+struct pwm_chan {
+    int pin;                            // -1 = 빈 채널
+    u64 period;                         // ns
+    u64 duty;                           // ns
+    u64 start;                          // 이번 주기 시작 시각
+    u64 next;                           // 다음 edge 시각
+    bool level;                         // 지금 핀 출력
+    bool queued;                        // pwm_order 에 들어 있는지
+    u32 late;
+};
+
+static struct pwm_chan pwm_chan[GPIOTIMER_PWM_MAX];
+static struct pwm_chan *pwm_order[GPIOTIMER_PWM_MAX];  // next 오름차순
+static int pwm_nr;
+static struct hrtimer pwm_timer;
+static DEFINE_RAW_SPINLOCK(pwm_lock);   // 타이머 콜백과 설정 사이 (hard hrtimer 에서 잡으므로 raw)
+static DEFINE_MUTEX(pwm_mutex);         // 채널 할당과 gpio_request
+static u64 pwm_lat_max;                 // edge 예정 시각에서 실제 처리까지 최대 지연 (ns)
+
+// pwm_order[i] 를 next 순서에 맞는 자리로 옮긴다. 채널이 몇 개뿐이라 삽입 정렬로 충분하다.
+static void pwm_sort_at(int i)
+{
+    struct pwm_chan *ch = pwm_order[i];
+
+    for (; i > 0 && pwm_order[i - 1]->next > ch->next; i--)
+        pwm_order[i] = pwm_order[i - 1];
+    for (; i < pwm_nr - 1 && pwm_order[i + 1]->next < ch->next; i++)
+        pwm_order[i] = pwm_order[i + 1];
+    pwm_order[i] = ch;
+}
+
+static void pwm_dequeue(struct pwm_chan *ch)
+{
+    int i;
+
+    if (!ch->queued)
+        return;
+    for (i = 0; pwm_order[i] != ch; i++)
+        ;
+    for (pwm_nr--; i < pwm_nr; i++)
+        pwm_order[i] = pwm_order[i + 1];
+    ch->queued = false;
+}
+
+static void pwm_enqueue(struct pwm_chan *ch)
+{
+    pwm_order[pwm_nr++] = ch;
+    ch->queued = true;
+    pwm_sort_at(pwm_nr - 1);
+}
+
+// 채널의 edge 하나를 mask[0](set)/mask[1](clear) 에 모으고 다음 edge 시각을 정한다.
+static void pwm_edge(struct pwm_chan *ch, u64 now, u32 *mask)
 {
-        gpio_set_value(GPIO_LED, data);      /* LED의 상태 설정 */
+    if (ch->level) {
+        mask[0] &= ~BIT(ch->pin);
+        mask[1] |= BIT(ch->pin);
+        ch->level = false;
+        ch->next = ch->start + ch->period;
+        return;
+    }
+    ch->start = ch->next;
+    // 한 주기 넘게 늦었으면 밀린 펄스를 몰아 내지 않고 지금부터 주기를 다시 잡는다.
+    if (ch->start + ch->period <= now) {
+        ch->start = now;
+        ch->late++;
+    }
+    mask[1] &= ~BIT(ch->pin);
+    mask[0] |= BIT(ch->pin);
+    ch->level = true;
+    ch->next = ch->start + ch->duty;
+}
+
+/* 타이머 처리를 위한 함수 : 지난 edge 를 모두 내고 다음 edge 에 타이머를 맞춘다 */
+/* 같은 때 도래한 edge 는 GPSET0/GPCLR0 쓰기 한 번씩으로 함께 바뀐다. */
+static enum hrtimer_restart pwm_func(struct hrtimer *t)
+{
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    struct pwm_chan *ch;
+    u32 mask[2] = { 0, 0 };
+    unsigned long flags;
+    u64 now = ktime_to_ns(hrtimer_cb_get_time(t));
+
+    raw_spin_lock_irqsave(&pwm_lock, flags);
+    if (pwm_nr && now > pwm_order[0]->next && now - pwm_order[0]->next > pwm_lat_max)
+        pwm_lat_max = now - pwm_order[0]->next;
+    while (pwm_nr && pwm_order[0]->next <= now) {
+        ch = pwm_order[0];
+        pwm_edge(ch, now, mask);
+        pwm_sort_at(0);
+    }
+    gpio_write_masks(mask[0], mask[1]);
+    // 콜백이 락을 기다리는 사이 pwm_set() 이 hrtimer_start() 로 이미 다시 걸었으면
+    // 큐에 든 타이머의 만료 시각을 건드리지 않는다. 그 타이머가 깨면 다시 맞춘다.
+    if (pwm_nr && !hrtimer_is_queued(t)) {
+        hrtimer_set_expires(t, ns_to_ktime(pwm_order[0]->next));
+        ret = HRTIMER_RESTART;
+    }
+    raw_spin_unlock_irqrestore(&pwm_lock, flags);
+    return ret;
+}
+
+static struct pwm_chan *pwm_find(int pin)
+{
+    int i;
+
+    for (i = 0; i < GPIOTIMER_PWM_MAX; i++)
+        if (pwm_chan[i].pin == pin)
+            return &pwm_chan[i];
+    return NULL;
+}
 
-        /* 다음 실행을 위한 타이머 설정 */
-        timer.data = !data;                                /* LED의 상태를 토글 */  
-        timer.expires = jiffies + ((1*HZ)/8);             /* LED의 켜고 끄는 주기는 1초 */         
-        add_timer(&timer);                                /* 타이머 추가 */         
+// pin 의 주기와 duty 를 바꾼다. 새 설정은 지금 시작하는 주기부터 적용된다.
+static int pwm_set(int pin, u32 period_us, u32 duty_us)
+{
+    struct pwm_chan *ch;
+    unsigned long flags;
+    u64 now;
+
+    if (pin == GPIO_SW || pin >= 32 || !gpio_is_valid(pin))
+        return -EINVAL;
+    if (period_us && period_us < GPIOTIMER_PWM_MIN_US)
+        return -EINVAL;
+
+    mutex_lock(&pwm_mutex);
+    if (bulk_pins & BIT(pin)) {
+        mutex_unlock(&pwm_mutex);
+        return -EBUSY;
+    }
+    ch = pwm_find(pin);
+    if (!ch && !period_us) {
+        mutex_unlock(&pwm_mutex);
+        return 0;
+    }
+    if (!ch) {
+        // 타이머 콜백(hard IRQ)에서 핀을 바꾸므로 잠들 수 있는 GPIO 는 안 된다.
+        ch = pwm_find(-1);
+        if (!ch || (pin != GPIO_LED && gpio_request(pin, "PWM") < 0)) {
+            mutex_unlock(&pwm_mutex);
+            return ch ? -EBUSY : -ENOSPC;
+        }
+        if (gpio_cansleep(pin)) {
+            if (pin != GPIO_LED)
+                gpio_free(pin);
+            mutex_unlock(&pwm_mutex);
+            return -EINVAL;
+        }
+        gpio_direction_output(pin, 0);
+        ch->late = 0;
+    }
+
+    raw_spin_lock_irqsave(&pwm_lock, flags);
+    pwm_dequeue(ch);
+    ch->pin = pin;
+    ch->period = (u64)period_us * 1000;
+    ch->duty = (u64)(duty_us < period_us ? duty_us : period_us) * 1000;
+    ch->level = period_us && ch->duty == ch->period;
+    gpio_set_value(pin, ch->level);
+    if (ch->duty && ch->duty < ch->period) {
+        now = ktime_get_ns();
+        ch->next = now;
+        pwm_enqueue(ch);
+        // 맨 앞이 바뀌었으면 타이머를 당긴다.
+        if (pwm_order[0] == ch)
+            hrtimer_start(&pwm_timer, ns_to_ktime(now), PWM_TIMER_MODE);
+    }
+    raw_spin_unlock_irqrestore(&pwm_lock, flags);
+
+    if (!period_us) {
+        if (pin != GPIO_LED)
+            gpio_free(pin);
+        ch->pin = -1;
+    }
+    mutex_unlock(&pwm_mutex);
+    return 0;
+}
+
+// IRQ 스레드에 irq_prio 를 적용한다. 처음 한 번은 init 이 irq_wake_thread() 로 깨운 것이므로
+// 적용 결과를 switch_rt_done 으로 알리고 true 를 돌려준다. 이때 핸들러는 LED 를 건드리지 않는다.
+// 5.9 부터 sched_setscheduler_nocheck() 가 export 되지 않아 sched_setattr_nocheck() 를 쓴다.
+static bool irq_thread_rt(void)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    struct sched_attr attr = {
+        .size           = sizeof(attr),
+        .sched_policy   = SCHED_FIFO,
+        .sched_priority = irq_prio,
+    };
+#else
+    struct sched_param param = { .sched_priority = irq_prio };
+#endif
+
+    if (switch_rt || irq_prio <= 0)
+        return false;
+    switch_rt = true;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    switch_rt_err = sched_setattr_nocheck(current, &attr);
+#else
+    switch_rt_err = sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+#endif
+    complete(&switch_rt_done);
+    return true;
 }
 
-/* 인터럽트 처리를 위한 인터럽트 서비스 루틴(Interrupt Service Routine) */
+// IRQ 스레드를 한 번 깨워 첫 edge 전에 irq_prio 를 적용시키고 결과를 돌려준다.
+static int irq_thread_prime(void)
+{
+    if (irq_prio <= 0)
+        return 0;
+    irq_wake_thread(switch_irq, NULL);
+    if (!wait_for_completion_timeout(&switch_rt_done, HZ)) {
+        printk(KERN_ERR "switch : IRQ thread did not run\n");
+        return -ETIMEDOUT;
+    }
+    if (switch_rt_err)
+        printk(KERN_ERR "switch : SCHED_FIFO %d failed (%d)\n", irq_prio, switch_rt_err);
+    return switch_rt_err;
+}
+
+// IRQ 를 irq_cpu 로 보낸다. IRQ 스레드도 IRQ 의 affinity 를 따라간다. mask 가 NULL 이면 hint 만 지운다.
+static void irq_pin_cpu(int irq, const struct cpumask *mask)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+    irq_set_affinity_and_hint(irq, mask);
+#else
+    irq_set_affinity_hint(irq, mask);
+#endif
+}
+
+/* top half : 시각만 찍고 스레드를 깨운다 */
+static irqreturn_t isr_top(int irq, void *data)
+{
+    switch_ts = ktime_get_ns();
+    return IRQ_WAKE_THREAD;
+}
+
+/* 인터럽트 처리를 위한 인터럽트 서비스 루틴(Interrupt Service Routine) : IRQ 스레드 */
 static irqreturn_t isr_func(int irq, void *data)
 {
+    u64 lat;
+
+    if (irq_thread_rt())
+        return IRQ_HANDLED;
+    lat = ktime_get_ns() - READ_ONCE(switch_ts);
+    if (lat > switch_lat_max)
+        switch_lat_max = lat;
+
     if(irq == switch_irq && !gpio_get_value(GPIO_LED)) {
         gpio_set_value(GPIO_LED, 1);
     } else if(irq == switch_irq && gpio_get_value(GPIO_LED)) {
@@ -103,6 +429,81 @@ static ssize_t gpio_read(struct file *inode, char *buff, size_t len, loff_t *off
     return count;
 }
 
+// 처음 쓰는 bulk 핀을 출력으로 잡는다. PWM 이 돌리는 핀과 스위치 핀은 안 된다.
+static int bulk_claim(u32 pins, u32 set)
+{
+    int pin, ret = 0;
+
+    mutex_lock(&pwm_mutex);
+    for (pin = 0; pin < 32 && !ret; pin++) {
+        if (!(pins & BIT(pin)) || (bulk_pins & BIT(pin)))
+            continue;
+        if (pin == GPIO_SW || pwm_find(pin) || !gpio_is_valid(pin))
+            ret = -EBUSY;
+        else if (pin != GPIO_LED && gpio_request(pin, "BULK") < 0)
+            ret = -EBUSY;
+        else if (gpio_cansleep(pin)) {
+            if (pin != GPIO_LED)
+                gpio_free(pin);
+            ret = -EINVAL;
+        }
+        else {
+            gpio_direction_output(pin, !!(set & BIT(pin)));
+            WRITE_ONCE(bulk_pins, bulk_pins | BIT(pin));
+        }
+    }
+    mutex_unlock(&pwm_mutex);
+    return ret;
+}
+
+// set/clear 를 레지스터 쓰기 한 번씩으로 낸다. 이미 잡은 핀만 쓰면 락도 안 잡는다.
+static int bulk_write(struct gpiotimer_bulk *bulk)
+{
+    u32 pins = bulk->set_mask | bulk->clear_mask;
+    int ret;
+
+    if (bulk->set_mask & bulk->clear_mask)
+        return -EINVAL;
+    if (pins & ~READ_ONCE(bulk_pins)) {
+        ret = bulk_claim(pins, bulk->set_mask);
+        if (ret < 0)
+            return ret;
+    }
+    gpio_write_masks(bulk->set_mask, bulk->clear_mask);
+    return 0;
+}
+
+static long gpio_ioctl(struct file *fil, unsigned int cmd, unsigned long arg)
+{
+    struct gpiotimer_pwm pwm;
+    struct gpiotimer_bulk bulk;
+    struct pwm_chan *ch;
+
+    if (cmd == GPIOTIMER_IOC_BULK) {
+        if (copy_from_user(&bulk, (void __user *)arg, sizeof(bulk)))
+            return -EFAULT;
+        return bulk_write(&bulk);
+    }
+    if (copy_from_user(&pwm, (void __user *)arg, sizeof(pwm)))
+        return -EFAULT;
+
+    switch (cmd) {
+    case GPIOTIMER_IOC_SET_PWM:
+        return pwm_set(pwm.pin, pwm.period_us, pwm.duty_us);
+    case GPIOTIMER_IOC_GET_PWM:
+        mutex_lock(&pwm_mutex);
+        ch = pwm_find(pwm.pin);
+        pwm.period_us = ch ? div_u64(ch->period, 1000) : 0;
+        pwm.duty_us = ch ? div_u64(ch->duty, 1000) : 0;
+        pwm.late = ch ? ch->late : 0;
+        mutex_unlock(&pwm_mutex);
+        pwm.pad = 0;
+        return copy_to_user((void __user *)arg, &pwm, sizeof(pwm)) ? -EFAULT : 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
 static ssize_t gpio_write(struct file *inode, const char *buff, size_t len, loff_t *off)
 {
     short count;
@@ -113,18 +514,13 @@ static ssize_t gpio_write(struct file *inode, const char *buff, size_t len, loff
     //===========================================================
     count = copy_from_user(msg, buff, len);
 
-    if(!strcmp(msg, "0")) {
-        del_timer_sync(&timer);  
-        gpio_set_value(GPIO_LED, 0);
-    } else {
-        /* 타이머 초기화와 타이머 처리를 위한 함수 등록 */  
-        init_timer(&timer);
-        timer.function = timer_func; 
-        /* timer_list 구조체 초기화 : 기본값 LDE 켜기, 주기 1초 */  
-        timer.data = 1L;                                 
-        timer.expires = jiffies + ((1*HZ)/8);
-        add_timer(&timer); 
-    }
+    //===========================================================
+    // "0" 이면 LED 를 끄고, 아니면 PWM 채널로 깜빡인다. (1/8 초마다 토글)
+    //===========================================================
+    if(!strcmp(msg, "0"))
+        pwm_set(GPIO_LED, 0, 0);
+    else
+        pwm_set(GPIO_LED, 250000, 125000);
 
     printk("GPIO Device write : %s(%d)\n", msg, len);
     return count;
@@ -140,13 +536,18 @@ int GPIO_init(void)
     dev_t devno;
     unsigned int count;
    // static void *map;                                   /* I/O 접근을 위한 변수 */
-    int err;
+    int err, i;
 
     //===========================================================
     // insmod를 통해 initModule이 호출되었음을 확인 
     //===========================================================
     printk(KERN_INFO "Hello module!\n");
 
+    if (irq_prio < 0 || irq_prio > MAX_RT_PRIO - 1) {
+        printk(KERN_ERR "irq_prio %d : must be 0-%d\n", irq_prio, MAX_RT_PRIO - 1);
+        return -EINVAL;
+    }
+
     //===========================================================
     // major와 minor를 전달하고 디바이스 파일의 번호를 받는다.
     // Major 200, Minor 199의 경우 devNo=0x0c8000c7이다. 
@@ -188,24 +589,80 @@ int GPIO_init(void)
     // GPIO 핀 방향 설정 
     //===========================================================    
     gpio_direction_output(GPIO_LED, 0);
+    gpio_map_probe();
+
+    //===========================================================
+    // PWM 타이머 초기화 : 채널이 생기면 그때 시작한다.
+    //===========================================================
+    for (i = 0; i < GPIOTIMER_PWM_MAX; i++)
+        pwm_chan[i].pin = -1;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+    hrtimer_setup(&pwm_timer, pwm_func, CLOCK_MONOTONIC, PWM_TIMER_MODE);
+#else
+    hrtimer_init(&pwm_timer, CLOCK_MONOTONIC, PWM_TIMER_MODE);
+    pwm_timer.function = pwm_func;
+#endif
 
     // GPIO 핀 IRQ 등록 
     switch_irq = gpio_to_irq(GPIO_SW);
 
     // GPIO IRQ Handler 등록 
     //request_irq(switch_irq, isr_func, IRQF_TRIGGER_RISING | IRQF_DISABLED, "switch", NULL);
-    request_irq(switch_irq, isr_func, IRQF_TRIGGER_RISING, "switch", NULL);
+    err = request_threaded_irq(switch_irq, isr_top, isr_func, IRQF_TRIGGER_RISING, "switch", NULL);
+    if (err < 0) {
+        printk("Error : switch IRQ %d (%d)\n", switch_irq, err);
+        goto err_irq;
+    }
+    if (irq_cpu >= 0 && irq_cpu < nr_cpu_ids && cpu_online(irq_cpu))
+        irq_pin_cpu(switch_irq, cpumask_of(irq_cpu));
+    err = irq_thread_prime();
+    if (err)
+        goto err_prio;
     return 0;
+
+    //===========================================================
+    // 실패하면 잡은 순서의 반대로 풀고 로드를 실패시킨다.
+    // PWM 타이머는 채널이 생겨야 돌므로 아직 멈춰 있다.
+    //===========================================================
+err_prio:
+    irq_pin_cpu(switch_irq, NULL);
+    free_irq(switch_irq, NULL);
+err_irq:
+    if (gpio_map)
+        iounmap(gpio_map);
+    gpio_free(GPIO_LED);
+    gpio_free(GPIO_SW);
+    cdev_del(&gpio_cdev);
+    unregister_chrdev_region(devno, 1);
+    return err;
 }
 
 void GPIO_exit(void)
 {
     dev_t devno = MKDEV(GPIO_MAJOR, GPIO_MINOR);
+    int i;
 
     //===========================================================
-    // 등록 했던 타이머를 삭제해 준다. 
+    // 등록 했던 타이머를 삭제하고 PWM 핀을 low 로 돌린다.
     //===========================================================
-    del_timer_sync(&timer);
+    hrtimer_cancel(&pwm_timer);
+    for (i = 0; i < GPIOTIMER_PWM_MAX; i++) {
+        if (pwm_chan[i].pin < 0)
+            continue;
+        gpio_set_value(pwm_chan[i].pin, 0);
+        if (pwm_chan[i].pin != GPIO_LED)
+            gpio_free(pwm_chan[i].pin);
+    }
+    for (i = 0; i < 32; i++) {
+        if (!(bulk_pins & BIT(i)))
+            continue;
+        gpio_set_value(i, 0);
+        if (i != GPIO_LED)
+            gpio_free(i);
+    }
+    if (gpio_map)
+        iounmap(gpio_map);
+    printk(KERN_INFO "pwm edge latency max : %llu ns\n", (unsigned long long)pwm_lat_max);
 
     //===========================================================
     // 문자 디바이스의 등록을 해제한다.
@@ -220,7 +677,9 @@ void GPIO_exit(void)
     //===========================================================
     // 사용이 끝난 인터럽트 해제
     //=========================================================== 
+    irq_pin_cpu(switch_irq, NULL);
     free_irq(switch_irq, NULL);
+    printk(KERN_INFO "switch irq latency max : %llu ns\n", (unsigned long long)switch_lat_max);
 
     //===========================================================   
     // 더 이상 사용이 필요없는 경우 관련 자원을 해제한다.
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+#include "gpiotimer_ioctl.h"
+
+// 사용법: ./pwm pin period_us duty_us
+// period_us 를 0 으로 주면 그 핀의 PWM 을 끈다.
+int main(int argc, char** argv)
+{
+    struct gpiotimer_pwm pwm = { 0 };
+    int fd;
+
+    if (argc < 4) {
+        printf("Usage : %s pin period_us duty_us\n", argv[0]);
+        return -1;
+    }
+    pwm.pin = atoi(argv[1]);
+    pwm.period_us = atoi(argv[2]);
+    pwm.duty_us = atoi(argv[3]);
+
+    fd = open("/dev/gpioled", O_RDWR);
+    if (fd < 0) {
+        printf("can not open /dev/gpioled\n");
+        return -1;
+    }
+    if (ioctl(fd, GPIOTIMER_IOC_SET_PWM, &pwm) < 0)
+        printf("Failed to set pwm of pin %d\n", pwm.pin);
+    if (ioctl(fd, GPIOTIMER_IOC_GET_PWM, &pwm) == 0)
+        printf("pin %u : period %u us, duty %u us, late %u\n",
+               pwm.pin, pwm.period_us, pwm.duty_us, pwm.late);
+    close(fd);
+    return 0;
+}
@@ -2,318 +2,770 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/i2c-dev.h>
+#include <linux/i2c.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 
-#define filename "/dev/i2c-1"
+#include "pca9685.h"
+#include "pca9685_sim.h"
 
-//레지스터 맵 define으로 설정
+// 데이터시트의 power-on reset 값으로 shadow 를 채운다.
+static void shadow_por(struct pca9685 *dev)
+{
+	int ch;
+
+	dev->shadow[MODE1] = MODE1_SLEEP | MODE1_ALLCALL;
+	dev->shadow[MODE2] = MODE2_OUTDRV;
+	dev->shadow[SUBADR1] = 0xE2;
+	dev->shadow[SUBADR2] = 0xE4;
+	dev->shadow[SUBADR3] = 0xE8;
+	dev->shadow[ALLCALLADR] = 0xE0;
+	for(ch = 0; ch < LED_NUM; ch++)
+		dev->shadow[LED_REG(ch) + 3] = 0x10;	// full off
+	dev->shadow[PRE_SCALE] = 0x1E;
+}
+
+struct pca9685 *pca9685_open(const char *bus, int addr)
+{
+	struct pca9685 *dev;
+
+	dev = calloc(1, sizeof(*dev));
+	if(dev == NULL)
+		return NULL;
+	dev->addr = addr;
+	dev->slave = -1;
+	snprintf(dev->bus, sizeof(dev->bus), "%s", bus);
+	dev->stagger = 1;
+	dev->retries = XFER_RETRIES;
+	dev->mode2 = MODE2_OUTDRV;
+	dev->bus_hz = BUS_HZ;
+	dev->check_pct = CHECK_PCT;
+	dev->check_pos = MODE2;
+	shadow_por(dev);
+
+	// 하드웨어 없이 돌릴 때는 프로세스 안의 가상 버스에 붙는다.
+	if(!strncmp(bus, SIM_PREFIX, strlen(SIM_PREFIX))){
+		if(pca9685_sim_attach(dev) < 0){
+			free(dev);
+			return NULL;
+		}
+		return dev;
+	}
 
-#define MODE1 0x00
-#define MODE2 0x01
-#define SUBADR1 0x02
+	if((dev->fd = open(bus, O_RDWR))<0){
+		printf("Failed to open the i2c bus\n");
+		free(dev);
+		return NULL;
+	}
+	// 어댑터가 지원하는 기능을 보고 가장 빠른 backend 를 고른다.
+	if(ioctl(dev->fd,I2C_FUNCS,&dev->funcs)<0 || (dev->backend = pca9685_probe(dev->funcs)) == NULL){
+		printf("Failed to find an i2c backend for %s\n", bus);
+		close(dev->fd);
+		free(dev);
+		return NULL;
+	}
+	return dev;
+}
 
- //#define LED8_ON_L 0x26
- //#define LED8_ON_H 0x27
- //#define LED8_OFF_L 0x28
- //#define LED8_OFF_H 0x29
- #define LED8_ON_L 0x06
- #define LED8_ON_H 0x07
- #define LED8_OFF_L 0x08
- #define LED8_OFF_H 0x09
-#define ALL_LED_ON_L 0xFA
+void pca9685_close(struct pca9685 *dev)
+{
+	if(dev == NULL)
+		return;
+	if(dev->fd >= 0)
+		close(dev->fd);
+	free(dev);
+}
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
 
-#define PRE_SCALE 0xFE
-#define CLOCK_FREQ 25000000.0
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
+static void hist_add(struct pca9685 *dev, int op, uint64_t ns)
+{
+	int k = ns ? 63 - __builtin_clzll(ns) : 0;
 
-#define PCA9685_ADDR 0x40
+	dev->stats.hist[op][k < HIST_BUCKETS ? k : HIST_BUCKETS - 1]++;
+}
 
-int fd;
-int pca_addr = 0x40;
-int reg_read8(int addr)
+// 버스 충돌(arbitration lost), 타임아웃, NAK 는 다시 보내 볼 만하다.
+// 레지스터 쓰기는 같은 값을 다시 써도 결과가 같으므로 일부만 나간 전송도 통째로 다시 보낸다.
+static int xfer_retryable(int err)
 {
-	unsigned char buffer[60] = {0};
-	int temp = 0,length = 0;
+	return err == EAGAIN || err == ETIMEDOUT || err == EIO || err == ENXIO || err == EREMOTEIO;
+}
 
-	// reg addr write 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = addr;
-	length =1;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
+// 모든 버스 전송이 지나는 곳. backend 를 부르고 통계를 센다.
+int pca9685_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n)
+{
+	uint64_t t;
+	int i, ret, try, op = STAT_WRITE;
+
+	for(i = 0; i < n; i++){
+		if(msgs[i].len <= 0 || msgs[i].len > REG_FILE_SIZE)
+			return -1;
+		if(msgs[i].read)
+			op = STAT_READ;
+	}
+	dev->stats.transactions += n;
+	t = now_ns();
+	for(try = 0; ; try++){
+		errno = 0;
+		ret = dev->backend->xfer(dev, msgs, n);
+		if(ret == 0)
+			break;
+		if(errno == 0)
+			errno = EIO;	// 일부 메시지만 나간 경우
+		if(errno == ENXIO || errno == EREMOTEIO)
+			dev->stats.naks++;
+		if(try >= dev->retries || !xfer_retryable(errno))
+			break;
+		dev->stats.retries++;
+	}
+	hist_add(dev, op, now_ns() - t);
+	if(ret < 0){
+		printf("Failed to %s the i2c bus (%s)\n", op == STAT_READ ? "read from" : "write to", strerror(errno));
+		dev->stats.errors++;
+		return -1;
+	}
+	for(i = 0; i < n; i++){
+		if(msgs[i].read){
+			dev->stats.tx_bytes += 1;
+			dev->stats.rx_bytes += msgs[i].len;
+		}
+		else
+			dev->stats.tx_bytes += msgs[i].len + 1;
 	}
+	return 0;
+}
 
-	// reg read 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	if(read(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	printf("addr[%d] = %d\n",addr, buffer[0]);
+// 레지스터 포인터 write 와 read 를 한 번에 읽는다(rdwr 은 repeated start).
+// AI 가 켜져 있으면 addr 부터 len 바이트(LEDn 블록, 0x00~0x45 전체 등)를 연속으로 읽는다.
+int pca9685_read(struct pca9685 *dev, int addr, uint8_t *data, int len)
+{
+	struct pca9685_msg msg = { dev->addr, addr, 1, len, data };
 
+	if(len <= 0 || len > REG_FILE_SIZE)
+		return -1;
+	return pca9685_xfer(dev, &msg, 1);
 }
 
-int reg_read16(int addr)
+// MODE1 AI 가 켜져 있으면 addr 부터 len 바이트를 한 번의 전송으로 쓴다.
+int pca9685_write(struct pca9685 *dev, int addr, const uint8_t *data, int len)
 {
-	unsigned char buffer[60] = {0};
-	int temp = 0 , length = 0;
+	struct pca9685_msg msg = { dev->addr, addr, 0, len, (uint8_t *)data };
 
-	// reg addr write 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = addr;
-	length =1;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	// reg read 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	
-	if(read(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	temp = buffer[0];
-		// reg addr write 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	
-	buffer[0] = addr + 1;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	// reg read 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	
-	if(read(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	temp = buffer[0]<<8 | temp;
-	printf("addr[%d] = %d\n",addr,temp);
+	if(len <= 0 || len > REG_FILE_SIZE || addr + len > REG_NUM)
+		return -1;
+	if(pca9685_xfer(dev, &msg, 1) < 0)
+		return -1;
+
+	// 칩에 쓴 값은 shadow 에도 반영하고 dirty 를 지운다.
+	memmove(&dev->shadow[addr], data, len);
+	pca9685_clean(dev, addr, len);
+	return 0;
 }
 
-int reg_write8(int addr, int data)
+static void led_pack(uint8_t *data, int on, int off)
 {
-	unsigned char buffer[60] = {0};
-	int length =2;
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
+	data[0] = on & 0xff;
+	data[1] = (on >> 8) & 0x1f;
+	data[2] = off & 0xff;
+	data[3] = (off >> 8) & 0x1f;
+}
 
-	buffer[0] = addr;
-	buffer[1] = data;
-	
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}	
+// 채널 하나의 ON_L/ON_H/OFF_L/OFF_H 를 5바이트 전송 한 번으로 갱신
+int pca9685_led_write(struct pca9685 *dev, int ch, int on, int off)
+{
+	uint8_t data[4];
+
+	if(ch < 0 || ch >= LED_NUM)
+		return -1;
+	led_pack(data, on, off);
+	return pca9685_write(dev, LED_REG(ch), data, 4);
 }
 
-int reg_write16(int addr, int data)
+// 16채널 전체(LED0_ON_L ~ LED15_OFF_H)를 65바이트 전송 한 번으로 갱신
+int pca9685_led_write_all(struct pca9685 *dev, const uint16_t *on, const uint16_t *off)
 {
-	unsigned char buffer[60] = {0};
-	int length =2;
+	uint8_t data[LED_NUM * 4];
+	int ch;
 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
+	for(ch = 0; ch < LED_NUM; ch++)
+		led_pack(&data[ch * 4], on[ch], off[ch]);
+	return pca9685_write(dev, LED0_ON_L, data, LED_NUM * 4);
+}
+
+// 채널 하나의 ON/OFF 값을 한 번에 읽는다.
+int pca9685_led_read(struct pca9685 *dev, int ch, int *on, int *off)
+{
+	uint8_t data[4];
+
+	if(ch < 0 || ch >= LED_NUM)
+		return -1;
+	if(pca9685_read(dev, LED_REG(ch), data, 4) < 0)
+		return -1;
+	*on = (data[1] & 0x1f) << 8 | data[0];
+	*off = (data[3] & 0x1f) << 8 | data[2];
+	return 0;
+}
 
-	buffer[0] = addr;
-	buffer[1] = data & 0xff;
+// MODE1 ~ LED15_OFF_H (0x00~0x45) 레지스터 파일 전체를 한 번에 읽는다.
+int pca9685_dump(struct pca9685 *dev, uint8_t *regs)
+{
+	return pca9685_read(dev, MODE1, regs, REG_FILE_SIZE);
+}
 
-	
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}	
+// shadow 만 갱신한다. 값이 바뀐 바이트만 dirty 로 표시되고 버스 전송은 flush() 에서 한다.
+void pca9685_set(struct pca9685 *dev, int addr, const uint8_t *data, int len)
+{
+	int i;
 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
+	for(i = 0; i < len && addr + i < REG_NUM; i++){
+		if(dev->shadow[addr + i] == data[i])
+			continue;
+		dev->shadow[addr + i] = data[i];
+		dev->dirty[(addr + i) / 32] |= 1u << ((addr + i) % 32);
 	}
+}
 
-	buffer[0] = addr+1;
-	buffer[1] = (data>>8) & 0xff;
+void pca9685_led_set(struct pca9685 *dev, int ch, int on, int off)
+{
+	uint8_t data[4];
 
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}	
-	printf("addr[%d]= %d\n",addr,data);
-}
-
-int led_on(int fd)
-{
-	int time_val_on = 2047 ,time_val = 4000;
-	char key;
-	while(key != 'c'){
-		printf("key insert :");
-		key = getchar();
-		if(key == 'a'){
-			if(time_val_on<3800){ 
-				
-				time_val_on += 10;
-				reg_write16(LED8_ON_L, time_val_on);
-				reg_read16(LED8_ON_L);
-
-				reg_write16(LED8_OFF_L, time_val - time_val_on);
-				reg_read16(LED8_OFF_L);
-			}
-			else printf("값 초과\n");
-		}
-		else if(key == 's'){
-			if(time_val_on>0){
-				time_val_on -= 10;
-				reg_write16(LED8_ON_L, time_val_on);
-				reg_read16(LED8_ON_L);
-
-				reg_write16(LED8_OFF_L, time_val - time_val_on);
-				reg_read16(LED8_OFF_L);
-			}
-			else printf("값 초과\n");
-		}
-	}
+	if(ch < 0 || ch >= LED_NUM)
+		return;
+	led_pack(data, on, off);
+	pca9685_set(dev, LED_REG(ch), data, 4);
 }
 
-int pca9685_freq(int fd)
+void pca9685_led_set_all(struct pca9685 *dev, const uint16_t *on, const uint16_t *off)
 {
-	int length = 2, freq = 100, pca_addr = 0x40;
-	unsigned char buffer[60] = {0};
-	uint8_t prescale_val = (CLOCK_FREQ / 4096 / freq) -1;
-	printf("prescale_val = %d \n", prescale_val);
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = MODE1;
-	buffer[1] = 0x10;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = PRE_SCALE;
-	buffer[1] = prescale_val;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = MODE1;
-	buffer[1] = 0x80;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
-	}
-	else{
-			printf("Data Mode1 %x\n",buffer[0]);
-	}
+	int ch;
 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
+	for(ch = 0; ch < LED_NUM; ch++)
+		pca9685_led_set(dev, ch, on[ch], off[ch]);
+}
+
+// duty(0 ~ DUTY_FULL tick)를 ON/OFF 쌍으로 바꿔 shadow 에 넣는다.
+// stagger 가 켜져 있으면 채널마다 ON 시점을 PHASE_STEP 씩 밀어 동시에 켜지는 채널을 분산한다.
+// 0% 와 100% 는 full off / full on 비트만 건드리므로 ON_L/OFF_L 은 다시 보내지 않는다.
+void pca9685_set_duty(struct pca9685 *dev, int ch, int duty)
+{
+	uint8_t data[4], *led;
+	int on;
+
+	if(ch < 0 || ch >= LED_NUM)
+		return;
+	led = &dev->shadow[LED_REG(ch)];
+
+	if(duty <= 0){
+		data[0] = led[3] | LED_FULL;
+		pca9685_set(dev, LED_REG(ch) + 3, data, 1);
 	}
-	buffer[0] = MODE2;
-	buffer[1] = 0x04;
-	length = 2;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
+	else if(duty >= DUTY_FULL){
+		data[0] = led[1] | LED_FULL;
+		data[1] = led[2];
+		data[2] = led[3] & ~LED_FULL;	// full off 가 full on 보다 우선한다
+		pca9685_set(dev, LED_REG(ch) + 1, data, 3);
 	}
 	else{
-			printf("Data Mode2 %x\n",buffer[0]);
+		on = dev->stagger ? ch * PHASE_STEP : 0;
+		led_pack(data, on, (on + duty) & (DUTY_FULL - 1));
+		pca9685_set(dev, LED_REG(ch), data, 4);
 	}
 }
 
-int pca9685_reset(int fd)
+void pca9685_set_duty_all(struct pca9685 *dev, const uint16_t *duty)
 {
-	unsigned char buffer[60] = {0};
-	int length, pca_addr = 0x40;
-	
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
-		return 0;
-	}
-	buffer[0] = MODE1;
-	buffer[1] = 0x00;
-	length = 2;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
-		return 0;
+	int ch;
+
+	for(ch = 0; ch < LED_NUM; ch++)
+		pca9685_set_duty(dev, ch, duty[ch]);
+}
+
+static int is_dirty(struct pca9685 *dev, int addr)
+{
+	return dev->dirty[addr / 32] & (1u << (addr % 32));
+}
+
+// 칩의 레지스터 파일을 읽어 shadow 를 맞춘다.
+int pca9685_sync(struct pca9685 *dev)
+{
+	uint8_t mode1;
+
+	// POR 직후처럼 AI 가 꺼져 있으면 연속 읽기가 MODE1 만 되풀이하므로 먼저 AI 를 켠다.
+	// RESTART 에 0 을 쓰는 것은 효과가 없어 멈춘 PWM 상태는 그대로 남는다.
+	if(pca9685_read(dev, MODE1, &mode1, 1) < 0)
+		return -1;
+	if(!(mode1 & MODE1_AI)){
+		mode1 = (mode1 & ~MODE1_RESTART) | MODE1_AI;
+		if(pca9685_write(dev, MODE1, &mode1, 1) < 0)
+			return -1;
+	}
+	if(pca9685_dump(dev, dev->shadow) < 0)
+		return -1;
+	if(pca9685_read(dev, PRE_SCALE, &dev->shadow[PRE_SCALE], 1) < 0)
+		return -1;
+	memset(dev->dirty, 0, sizeof(dev->dirty));
+	return 0;
+}
+
+static int flush_verify(struct pca9685 *dev, int addr, int len)
+{
+	uint8_t data[REG_FILE_SIZE];
+	int i, bad = 0;
+
+	if(pca9685_read(dev, addr, data, len) < 0)
+		return -1;
+	for(i = 0; i < len; i++){
+		if(data[i] != dev->shadow[addr + i]){
+			printf("readback mismatch addr[%d] = %d (expected %d)\n",
+					addr + i, data[i], dev->shadow[addr + i]);
+			bad++;
+		}
 	}
-	else{
-			printf("Data Mode1 %x\n",buffer[0]);
+	dev->stats.mismatches += bad;
+	return bad;
+}
+
+// dirty 바이트를 연속 구간으로 묶는다. 다음 dirty 바이트가 FLUSH_GAP 이내면
+// 같은 버스트로 합쳐 버스트 수를 최소화한다. 반환값은 구간 수
+int pca9685_dirty_bursts(struct pca9685 *dev, struct pca9685_burst *bursts, int max)
+{
+	int addr, start, end, n = 0;
+
+	for(addr = 0; addr < REG_NUM && n < max; addr++){
+		if(!is_dirty(dev, addr))
+			continue;
+
+		start = end = addr;
+		for(addr++; addr < REG_NUM && addr - start < REG_FILE_SIZE; addr++){
+			if(is_dirty(dev, addr))
+				end = addr;
+			else if(addr - end > FLUSH_GAP)
+				break;
+		}
+		bursts[n].addr = start;
+		bursts[n].len = end - start + 1;
+		n++;
+		addr = end;
 	}
+	return n;
+}
+
+// 다른 경로로 칩에 반영된 구간의 dirty 를 지운다.
+void pca9685_clean(struct pca9685 *dev, int addr, int len)
+{
+	int i;
 
-	if(ioctl(fd,I2C_SLAVE,pca_addr)<0){
-		printf("Failed to acquire bus access and/or talk to slave\n");
+	for(i = addr; i < addr + len && i < REG_NUM; i++)
+		dev->dirty[i / 32] &= ~(1u << (i % 32));
+}
+
+// dirty 구간을 auto-increment 버스트로 내보낸다. 버스트 전체를 backend 에 한 번에 넘기므로
+// rdwr backend 에서는 ioctl 한 번이 된다. 반환값은 보낸 버스트 수, 실패 시 -1
+int pca9685_flush(struct pca9685 *dev)
+{
+	struct pca9685_burst bursts[MAX_BURSTS];
+	struct pca9685_msg msgs[MAX_BURSTS];
+	uint64_t t;
+	int i, n, verify;
+
+	dev->stats.flushes++;
+	verify = dev->verify_every > 0 && (++dev->flush_count % dev->verify_every) == 0;
+	n = pca9685_dirty_bursts(dev, bursts, MAX_BURSTS);
+	if(n == 0)
 		return 0;
+	t = now_ns();
+	for(i = 0; i < n; i++){
+		msgs[i].addr = dev->addr;
+		msgs[i].reg = bursts[i].addr;
+		msgs[i].read = 0;
+		msgs[i].len = bursts[i].len;
+		msgs[i].buf = &dev->shadow[bursts[i].addr];
+	}
+	if(pca9685_xfer(dev, msgs, n) < 0)
+		return -1;
+	for(i = 0; i < n; i++){
+		pca9685_clean(dev, bursts[i].addr, bursts[i].len);
+		if(verify)
+			flush_verify(dev, bursts[i].addr, bursts[i].len);
+	}
+	dev->stats.bursts += n;
+	hist_add(dev, STAT_FLUSH, now_ns() - t);
+	return n;
+}
+
+// 프레임 하나를 STOP 한 번에 반영하는 메시지를 만든다.
+// LED 블록 쪽 dirty 는 중간의 깨끗한 바이트까지 포함해 버스트 하나로 묶는다. 버스트가 나뉘면
+// rw/smbus backend 에서는 STOP 이 여러 번 생겨 OCH_STOP 에서도 프레임 중간 상태가 출력된다.
+// PRE_SCALE, ALL_LED_* 처럼 떨어진 레지스터는 앞쪽에 따로 싣는다. 반환값은 메시지 수, max(COMMIT_MSGS 면 충분)에 다 못 실으면 -1
+int pca9685_commit_msgs(struct pca9685 *dev, struct pca9685_msg *msgs, int max)
+{
+	struct pca9685_burst bursts[MAX_BURSTS];
+	int i, n, k = 0, first = -1, last = -1;
+
+	n = pca9685_dirty_bursts(dev, bursts, MAX_BURSTS);
+	for(i = 0; i < n; i++){
+		if(bursts[i].addr < REG_FILE_SIZE){
+			if(first < 0)
+				first = bursts[i].addr;
+			last = bursts[i].addr + bursts[i].len;
+			continue;
+		}
+		if(k == max)
+			return -1;
+		msgs[k].addr = dev->addr;
+		msgs[k].reg = bursts[i].addr;
+		msgs[k].read = 0;
+		msgs[k].len = bursts[i].len;
+		msgs[k].buf = &dev->shadow[bursts[i].addr];
+		k++;
+	}
+	if(first >= 0){
+		// LEDn 구간이 잘린 채 프레임이 나가면 안 된다.
+		if(k == max)
+			return -1;
+		msgs[k].addr = dev->addr;
+		msgs[k].reg = first;
+		msgs[k].read = 0;
+		msgs[k].len = (last > REG_FILE_SIZE ? REG_FILE_SIZE : last) - first;
+		msgs[k].buf = &dev->shadow[first];
+		k++;
+	}
+	return k;
+}
+
+// 보드 하나의 변경분을 프레임으로 보낸다. OCH_STOP 이면 16채널이 마지막 STOP 에서 함께 바뀐다.
+// 반환값은 보낸 메시지 수, 실패 시 -1
+int pca9685_commit(struct pca9685 *dev)
+{
+	struct pca9685_msg msgs[COMMIT_MSGS];
+	uint64_t t;
+	int i, n, verify;
+
+	dev->stats.flushes++;
+	verify = dev->verify_every > 0 && (++dev->flush_count % dev->verify_every) == 0;
+	n = pca9685_commit_msgs(dev, msgs, COMMIT_MSGS);
+	if(n <= 0)
+		return n;
+	t = now_ns();
+	if(pca9685_xfer(dev, msgs, n) < 0)
+		return -1;
+	for(i = 0; i < n; i++){
+		pca9685_clean(dev, msgs[i].reg, msgs[i].len);
+		if(verify)
+			flush_verify(dev, msgs[i].reg, msgs[i].len);
+	}
+	dev->stats.bursts += n;
+	hist_add(dev, STAT_FLUSH, now_ns() - t);
+	return n;
+}
+
+static int reg_write8(struct pca9685 *dev, int addr, int data)
+{
+	uint8_t val = data;
+
+	return pca9685_write(dev, addr, &val, 1);
+}
+
+// ALLCALL/SUBADR 응답 설정은 유지하고 AI 를 켠 MODE1 값
+static uint8_t mode1_base(struct pca9685 *dev)
+{
+	return (dev->shadow[MODE1] & (MODE1_SUB1 | MODE1_SUB2 | MODE1_SUB3 | MODE1_ALLCALL)) | MODE1_AI;
+}
+
+// prescale = round(CLOCK_FREQ / (4096 * hz)) - 1 을 정수로 계산한다.
+int pca9685_prescale(int hz)
+{
+	long div, prescale;
+
+	if(hz <= 0)
+		return PRESCALE_MAX;
+	div = 4096L * hz;
+	prescale = (CLOCK_FREQ + div / 2) / div - 1;
+	if(prescale < PRESCALE_MIN)
+		prescale = PRESCALE_MIN;
+	if(prescale > PRESCALE_MAX)
+		prescale = PRESCALE_MAX;
+	return prescale;
+}
+
+// prescale 로 실제 나오는 PWM 주파수 (1/1000 Hz 단위)
+uint32_t pca9685_prescale_millihz(int prescale)
+{
+	return (uint64_t)CLOCK_FREQ * 1000 / (4096UL * (prescale + 1));
+}
+
+// SLEEP 을 푼 뒤 발진기가 안정될 때까지 정확히 OSC_SETTLE_US 만큼 기다린다.
+void pca9685_osc_settle(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_nsec += OSC_SETTLE_US * 1000L;
+	if(ts.tv_nsec >= 1000000000L){
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
 	}
-	buffer[0] = MODE2;
-	buffer[1] = 0x04;
-	length = 2;
-	if(write(fd,buffer,length) != length){
-		printf("Failed to write from the i2c bus\n");
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+// sleep -> prescale -> wake -> 500us -> RESTART 순서로 주파수를 바꾼다.
+// RESTART 로 기존 PWM 출력이 그대로 재개되므로 LEDn 레지스터는 다시 쓰지 않는다.
+// PRE_SCALE 은 SLEEP 중에만 써지므로 재우고 쓴 뒤 발진기 안정 후 RESTART 로 PWM 을 재개한다.
+static int prescale_write(struct pca9685 *dev, uint8_t prescale)
+{
+	uint8_t mode1 = mode1_base(dev);
+
+	if(reg_write8(dev, MODE1, mode1 | MODE1_SLEEP) < 0)
+		return -1;
+	if(reg_write8(dev, PRE_SCALE, prescale) < 0)
+		return -1;
+	if(reg_write8(dev, MODE1, mode1) < 0)
+		return -1;
+	pca9685_osc_settle();
+	if(reg_write8(dev, MODE1, mode1 | MODE1_RESTART) < 0)
+		return -1;
+	// RESTART 비트는 쓰고 나면 칩이 스스로 지우므로 shadow 에는 남기지 않는다.
+	dev->shadow[MODE1] = mode1;
+	return 0;
+}
+
+int pca9685_set_frequency(struct pca9685 *dev, int hz, uint32_t *actual_millihz)
+{
+	uint8_t prescale = pca9685_prescale(hz);
+
+	if(prescale != dev->shadow[PRE_SCALE] && prescale_write(dev, prescale) < 0)
+		return -1;
+	if(actual_millihz)
+		*actual_millihz = pca9685_prescale_millihz(prescale);
+	return 0;
+}
+
+// 칩의 현재 상태를 읽어 shadow 를 맞추고 AI 와 MODE2(dev->mode2)만 설정한다.
+// MODE1 을 0 으로 지우지 않으므로 이미 돌고 있던 채널 출력은 그대로 유지된다.
+int pca9685_init(struct pca9685 *dev)
+{
+	uint8_t mode1;
+	int restart;
+
+	if(pca9685_sync(dev) < 0)
+		return -1;
+	restart = dev->shadow[MODE1] & MODE1_RESTART;
+	mode1 = mode1_base(dev);
+
+	if(dev->shadow[MODE2] != dev->mode2 && reg_write8(dev, MODE2, dev->mode2) < 0)
+		return -1;
+	if(dev->shadow[MODE1] == mode1)
 		return 0;
+	if(reg_write8(dev, MODE1, mode1) < 0)
+		return -1;
+	// sleep 중에 멈춘 PWM 이 있었다면 발진기 안정 후 RESTART 로 재개한다.
+	if(restart){
+		pca9685_osc_settle();
+		if(reg_write8(dev, MODE1, mode1 | MODE1_RESTART) < 0)
+			return -1;
+		dev->shadow[MODE1] = mode1;
 	}
-	else{
-			printf("Data Mode2 %x\n",buffer[0]);
-	}
+	return 0;
 }
 
-void fileopen()
+// 출력이 바뀌는 시점을 고른다. 다음 init 에도 유지된다.
+int pca9685_set_output_change(struct pca9685 *dev, int och)
 {
-	if((fd = open(filename, O_RDWR))<0){
-		printf("Failed to open the i2c bus\n");
-		return ;
-	}
-	pca9685_reset(fd);
-	pca9685_freq(fd);
-	led_on(fd);
+	uint8_t mode2 = (dev->mode2 & ~MODE2_OCH) | (och == OCH_ACK ? MODE2_OCH : 0);
+
+	if(dev->shadow[MODE2] != mode2 && reg_write8(dev, MODE2, mode2) < 0)
+		return -1;
+	dev->mode2 = mode2;
+	return 0;
 }
 
-int main()
+// brown-out 등으로 칩이 POR 상태가 됐을 때 shadow 를 칩에 다시 써 넣는다.
+// PRE_SCALE 은 SLEEP 중에만 써지므로 AI 와 SLEEP 을 켜고 쓴 뒤 MODE2 ~ LED15 를 버스트 하나로 보낸다.
+// POR 에서는 모든 채널이 full off 라 멈춘 PWM 이 없어 RESTART 는 필요 없다.
+int pca9685_restore(struct pca9685 *dev)
 {
-	fileopen();
+	uint8_t mode1 = dev->shadow[MODE1] & ~MODE1_RESTART;
+
+	if(reg_write8(dev, MODE1, mode1 | MODE1_SLEEP | MODE1_AI) < 0)
+		return -1;
+	if(pca9685_write(dev, PRE_SCALE, &dev->shadow[PRE_SCALE], 1) < 0)
+		return -1;
+	if(pca9685_write(dev, MODE2, &dev->shadow[MODE2], REG_FILE_SIZE - MODE2) < 0)
+		return -1;
+	if(!(mode1 & MODE1_SLEEP)){
+		if(reg_write8(dev, MODE1, mode1) < 0)
+			return -1;
+		pca9685_osc_settle();
+	}
+	dev->shadow[MODE1] = mode1;
+	dev->stats.resets++;
 	return 0;
 }
 
+// 칩이 스스로 바꾸는 비트(MODE1 RESTART)와 예약 비트(LEDn ON_H/OFF_H bit 7:5)는 비교하지 않는다.
+static int reg_differs(struct pca9685 *dev, int addr, uint8_t val)
+{
+	uint8_t mask = 0xff;
+
+	if(addr == MODE1)
+		mask = (uint8_t)~MODE1_RESTART;
+	else if(addr >= LED0_ON_L && addr < REG_FILE_SIZE && (addr - LED0_ON_L) & 1)
+		mask = 0x1f;
+	return (val ^ dev->shadow[addr]) & mask;
+}
+
+// 프레임의 남는 버스 시간에 부르는 무결성 검사. frame_us 의 check_pct% 를 넘지 않는 만큼
+// MODE1 과 레지스터 파일의 다음 조각을 읽어 shadow 와 비교한다. 조각은 호출마다 돌아가므로
+// MODE2 ~ LED15, PRE_SCALE 전체가 몇 프레임에 한 번씩 검사된다.
+// MODE1 이 POR 상태(SLEEP 또는 AI 꺼짐)면 pca9685_restore(), 나머지 불일치는 그 바이트를
+// dirty 로 되돌려 pca9685_commit() 으로 다시 쓴다. 보내기 전인 dirty 바이트는 비교하지 않는다.
+// 반환값은 다시 쓴 바이트 수, 실패 시 -1
+int pca9685_check(struct pca9685 *dev, long frame_us)
+{
+	struct pca9685_msg msgs[2];
+	uint8_t mode1, data[REG_FILE_SIZE];
+	long bytes;
+	int i, addr, len, drift = 0;
 
+	if(dev->check_pct <= 0 || dev->bus_hz <= 0)
+		return 0;
+	// 바이트당 9bit. MODE1 읽기는 주소 + 레지스터 + 주소 + 데이터, 조각은 3바이트 + 데이터
+	bytes = (int64_t)frame_us * dev->check_pct / 100 * dev->bus_hz / 9 / 1000000;
+	len = bytes - 4 - 3;
+	if(len < 1)
+		return 0;
 
+	if(dev->check_pos < MODE2 || dev->check_pos > REG_FILE_SIZE)
+		dev->check_pos = MODE2;
+	addr = dev->check_pos == REG_FILE_SIZE ? PRE_SCALE : dev->check_pos;
+	if(addr == PRE_SCALE)
+		len = 1;
+	else if(len > REG_FILE_SIZE - addr)
+		len = REG_FILE_SIZE - addr;
+
+	msgs[0].addr = dev->addr;
+	msgs[0].reg = MODE1;
+	msgs[0].read = 1;
+	msgs[0].len = 1;
+	msgs[0].buf = &mode1;
+	msgs[1].addr = dev->addr;
+	msgs[1].reg = addr;
+	msgs[1].read = 1;
+	msgs[1].len = len;
+	msgs[1].buf = data;
+	if(pca9685_xfer(dev, msgs, 2) < 0)
+		return -1;
+	dev->stats.checked += 1 + len;
+
+	// AI 가 꺼져 있으면 조각은 같은 레지스터의 반복이라 믿을 수 없다.
+	if(!is_dirty(dev, MODE1) && ((mode1 & MODE1_SLEEP) > (dev->shadow[MODE1] & MODE1_SLEEP) || !(mode1 & MODE1_AI))){
+		printf("0x%02x: MODE1 = 0x%02x, restoring registers\n", dev->addr, mode1);
+		if(pca9685_restore(dev) < 0)
+			return -1;
+		dev->stats.drifts += REG_FILE_SIZE - MODE2 + 2;
+		return REG_FILE_SIZE - MODE2 + 2;
+	}
+	if(!is_dirty(dev, MODE1) && reg_differs(dev, MODE1, mode1)){
+		dev->dirty[MODE1 / 32] |= 1u << (MODE1 % 32);
+		drift++;
+	}
+	for(i = 0; i < len; i++){
+		if(is_dirty(dev, addr + i) || !reg_differs(dev, addr + i, data[i]))
+			continue;
+		drift++;
+		// PRE_SCALE 은 SLEEP 중에만 써지므로 commit 으로 보낼 수 없다.
+		if(addr + i == PRE_SCALE){
+			if(prescale_write(dev, dev->shadow[PRE_SCALE]) < 0)
+				return -1;
+		}
+		else
+			dev->dirty[(addr + i) / 32] |= 1u << ((addr + i) % 32);
+	}
+	dev->check_pos = addr == PRE_SCALE ? MODE2 : addr + len;
 
+	if(drift > 0){
+		dev->stats.drifts += drift;
+		if(pca9685_commit(dev) < 0)
+			return -1;
+	}
+	return drift;
+}
 
+void pca9685_get_stats(struct pca9685 *dev, struct pca9685_stats *stats)
+{
+	*stats = dev->stats;
+}
 
+// 히스토그램에서 pct% 가 들어가는 bucket 의 상한(ns). 비어 있으면 0
+uint64_t pca9685_stats_percentile(const unsigned long *hist, int pct)
+{
+	unsigned long total = 0, sum = 0;
+	int k;
 
+	for(k = 0; k < HIST_BUCKETS; k++)
+		total += hist[k];
+	if(total == 0)
+		return 0;
+	for(k = 0; k < HIST_BUCKETS - 1; k++){
+		sum += hist[k];
+		if(sum * 100 >= total * pct)
+			break;
+	}
+	return 2ULL << k;
+}
 
+static void print_ns(uint64_t ns)
+{
+	if(ns < 1000)
+		printf("%lluns", (unsigned long long)ns);
+	else if(ns < 1000000)
+		printf("%lluus", (unsigned long long)ns / 1000);
+	else
+		printf("%llums", (unsigned long long)ns / 1000000);
+}
+
+void pca9685_print_stats(struct pca9685 *dev)
+{
+	static const char *op_name[STAT_OPS] = { "write", "read", "flush" };
+	struct pca9685_stats *st = &dev->stats;
+	unsigned long total;
+	int op, k;
+
+	printf("%s 0x%02x (%s): transactions %lu, tx %lu, rx %lu, syscalls %lu\n", dev->bus, dev->addr,
+			dev->backend->name, st->transactions, st->tx_bytes, st->rx_bytes, st->syscalls);
+	printf("  errors %lu, retries %lu, naks %lu, mismatches %lu, flushes %lu, bursts %lu\n",
+			st->errors, st->retries, st->naks, st->mismatches, st->flushes, st->bursts);
+	printf("  checked %lu, drifts %lu, resets %lu\n", st->checked, st->drifts, st->resets);
+	for(op = 0; op < STAT_OPS; op++){
+		for(k = 0, total = 0; k < HIST_BUCKETS; k++)
+			total += st->hist[op][k];
+		if(total == 0)
+			continue;
+		// 분위수는 bucket 상한이라 실제 값보다 최대 2배 크게 나온다.
+		printf("  %-5s %lu, p50 < ", op_name[op], total);
+		print_ns(pca9685_stats_percentile(st->hist[op], 50));
+		printf(", p99 < ");
+		print_ns(pca9685_stats_percentile(st->hist[op], 99));
+		printf(" :");
+		for(k = 0; k < HIST_BUCKETS; k++){
+			if(st->hist[op][k] == 0)
+				continue;
+			printf(" <");
+			print_ns(2ULL << k);
+			printf(" %lu", st->hist[op][k]);
+		}
+		printf("\n");
+	}
+}
@@ -0,0 +1,184 @@
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include <stdint.h>
+
+#define PCA9685_BUS "/dev/i2c-1"
+#define PCA9685_ADDR 0x40
+
+//레지스터 맵 define으로 설정
+
+#define MODE1 0x00
+#define MODE2 0x01
+#define SUBADR1 0x02
+#define SUBADR2 0x03
+#define SUBADR3 0x04
+#define ALLCALLADR 0x05
+
+// MODE1 비트
+#define MODE1_RESTART 0x80
+#define MODE1_AI 0x20		// register auto-increment
+#define MODE1_SLEEP 0x10
+#define MODE1_SUB1 0x08
+#define MODE1_SUB2 0x04
+#define MODE1_SUB3 0x02
+#define MODE1_ALLCALL 0x01
+#define MODE2_INVRT 0x10
+#define MODE2_OCH 0x08		// 0: STOP 에서 출력 변경, 1: ACK 에서 출력 변경
+#define MODE2_OUTDRV 0x04
+
+// pca9685_set_output_change() 의 och
+#define OCH_STOP 0		// 전송이 끝나는 STOP 에서 모든 출력이 함께 바뀐다 (POR 기본값)
+#define OCH_ACK 1		// 채널의 4바이트를 다 받은 ACK 에서 그 채널만 바뀐다
+
+// LEDn 레지스터는 ON_L, ON_H, OFF_L, OFF_H 4바이트씩 연속으로 배치
+#define LED0_ON_L 0x06
+#define LED_REG(n) (LED0_ON_L + 4 * (n))
+#define LED_NUM 16
+#define REG_FILE_SIZE (LED_REG(LED_NUM))	// 0x00 ~ 0x45
+#define LED_FULL 0x10		// ON_H/OFF_H bit 4: full on / full off
+#define DUTY_FULL 4096		// duty 최대값 (항상 켜짐)
+#define PHASE_STEP (DUTY_FULL / LED_NUM)	// 채널별 ON 위상 간격
+
+#define ALL_LED_ON_L 0xFA
+#define ALL_LED_OFF_H 0xFD
+#define PRE_SCALE 0xFE
+#define CLOCK_FREQ 25000000L	// 내부 발진기
+#define PRESCALE_MIN 3
+#define PRESCALE_MAX 255
+#define OSC_SETTLE_US 500	// SLEEP 해제 후 발진기 안정 시간
+
+#define REG_NUM 256
+#define FLUSH_GAP 2		// 이 이하의 변경 없는 바이트는 버스트를 나누지 않고 같이 보낸다
+
+#define MAX_BURSTS (REG_NUM / (FLUSH_GAP + 2) + 1)
+// commit 한 번의 메시지 수 상한: MODE1 ~ LED15 구간 하나 + ALL_LED_* / PRE_SCALE 버스트 (최대 2개)
+#define COMMIT_MSGS 3
+
+// flush 한 번에 보낼 연속 레지스터 구간
+struct pca9685_burst {
+	int addr;
+	int len;
+};
+
+#define XFER_RETRIES 2		// 실패한 전송을 다시 보내는 기본 횟수
+#define BUS_HZ 100000		// 기본 SCL 속도
+#define CHECK_PCT 5		// 무결성 검사가 프레임마다 쓸 수 있는 버스 시간 (%)
+
+// 지연 히스토그램: bucket k 는 [2^k, 2^(k+1)) ns
+#define HIST_BUCKETS 32
+#define STAT_WRITE 0
+#define STAT_READ 1
+#define STAT_FLUSH 2
+#define STAT_OPS 3
+
+struct pca9685_stats {
+	unsigned long transactions;	// i2c 전송 수
+	unsigned long tx_bytes;		// 쓴 바이트 (레지스터 주소 포함)
+	unsigned long rx_bytes;		// 읽은 바이트
+	unsigned long errors;		// 재시도까지 실패한 전송
+	unsigned long retries;
+	unsigned long naks;		// 주소나 데이터에 ACK 가 없던 시도
+	unsigned long flushes;
+	unsigned long bursts;
+	unsigned long mismatches;	// readback 불일치 바이트
+	unsigned long syscalls;		// backend 가 부른 ioctl/read/write 수
+	unsigned long checked;		// 무결성 검사로 읽어 비교한 바이트
+	unsigned long drifts;		// shadow 와 달라 다시 쓴 바이트
+	unsigned long resets;		// POR 상태로 돌아가 전체를 다시 쓴 횟수
+	unsigned long hist[STAT_OPS][HIST_BUCKETS];	// write/read 전송, flush 전체의 지연
+};
+
+// backend 로 넘기는 전송 단위. addr 장치의 reg 부터 len 바이트를 쓰거나(read = 0) 읽는다(read = 1).
+struct pca9685_msg {
+	uint16_t addr;		// 7bit slave 주소 (ALLCALL/SUBADR 도 가능)
+	uint8_t reg;
+	uint8_t read;
+	uint16_t len;		// 1 ~ REG_FILE_SIZE
+	uint8_t *buf;
+};
+
+struct pca9685;
+
+// 어댑터마다 다른 전송 경로. xfer 는 msgs 를 순서대로 보내고 실패 시 -1
+struct pca9685_backend {
+	const char *name;
+	unsigned long funcs;	// 이 backend 에 필요한 I2C_FUNC_* 비트
+	int (*xfer)(struct pca9685 *dev, struct pca9685_msg *msgs, int n);
+};
+
+extern const struct pca9685_backend pca9685_backend_rdwr;	// I2C_RDWR: 여러 버스트를 ioctl 한 번에
+extern const struct pca9685_backend pca9685_backend_rw;		// I2C_SLAVE + write()/read()
+extern const struct pca9685_backend pca9685_backend_smbus;	// I2C_SMBUS: I2C block 32바이트 단위
+
+// 보드 하나에 대한 핸들. backend 는 open 시 어댑터의 I2C_FUNCS 를 보고 고른다.
+struct pca9685 {
+	int fd;
+	int addr;
+	char bus[32];
+	const struct pca9685_backend *backend;
+	unsigned long funcs;	// I2C_FUNCS 결과
+	int slave;		// I2C_SLAVE 로 묶인 주소 (-1 = 없음). 바뀔 때만 다시 ioctl 한다
+	void *priv;		// backend 전용 (sim 버스 등)
+	int retries;		// 전송 실패 시 다시 보내는 횟수
+	uint8_t mode2;		// init 이 칩에 맞춰 두는 MODE2 값
+
+	// 칩 레지스터의 호스트 측 사본과 변경(dirty) 비트맵
+	uint8_t shadow[REG_NUM];
+	uint32_t dirty[REG_NUM / 32];
+	int verify_every;	// N 번째 flush 마다 readback 검증 (0 = 사용 안 함)
+	int stagger;		// 채널마다 ON 위상을 PHASE_STEP 씩 어긋나게 둔다
+	unsigned long flush_count;
+
+	// 무결성 검사: 프레임마다 check_pct% 의 버스 시간 안에서 레지스터 파일을 조금씩 돌아가며 읽는다.
+	int bus_hz;		// 검사 분량 계산용 SCL 속도
+	int check_pct;		// 0 = 사용 안 함
+	int check_pos;		// 다음에 읽을 레지스터 (REG_FILE_SIZE 면 PRE_SCALE)
+
+	struct pca9685_stats stats;
+};
+
+struct pca9685 *pca9685_open(const char *bus, int addr);
+void pca9685_close(struct pca9685 *dev);
+const struct pca9685_backend *pca9685_probe(unsigned long funcs);
+int pca9685_set_backend(struct pca9685 *dev, const char *name);
+int pca9685_bind(struct pca9685 *dev, int addr);
+int pca9685_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n);
+
+int pca9685_init(struct pca9685 *dev);
+int pca9685_set_output_change(struct pca9685 *dev, int och);
+int pca9685_set_frequency(struct pca9685 *dev, int hz, uint32_t *actual_millihz);
+int pca9685_prescale(int hz);
+uint32_t pca9685_prescale_millihz(int prescale);
+void pca9685_osc_settle(void);
+
+// 버스에 바로 쓰고 읽는 함수 (AI 버스트)
+int pca9685_write(struct pca9685 *dev, int addr, const uint8_t *data, int len);
+int pca9685_read(struct pca9685 *dev, int addr, uint8_t *data, int len);
+int pca9685_led_write(struct pca9685 *dev, int ch, int on, int off);
+int pca9685_led_write_all(struct pca9685 *dev, const uint16_t *on, const uint16_t *off);
+int pca9685_led_read(struct pca9685 *dev, int ch, int *on, int *off);
+int pca9685_dump(struct pca9685 *dev, uint8_t *regs);
+
+// shadow 만 갱신하고 pca9685_flush() 에서 변경분만 내보내는 함수
+void pca9685_set(struct pca9685 *dev, int addr, const uint8_t *data, int len);
+void pca9685_led_set(struct pca9685 *dev, int ch, int on, int off);
+void pca9685_led_set_all(struct pca9685 *dev, const uint16_t *on, const uint16_t *off);
+void pca9685_set_duty(struct pca9685 *dev, int ch, int duty);
+void pca9685_set_duty_all(struct pca9685 *dev, const uint16_t *duty);
+int pca9685_sync(struct pca9685 *dev);
+int pca9685_restore(struct pca9685 *dev);
+int pca9685_check(struct pca9685 *dev, long frame_us);
+int pca9685_flush(struct pca9685 *dev);
+int pca9685_commit(struct pca9685 *dev);
+
+// flush 를 직접 조립하는 상위 계층(fleet 등)용
+int pca9685_dirty_bursts(struct pca9685 *dev, struct pca9685_burst *bursts, int max);
+int pca9685_commit_msgs(struct pca9685 *dev, struct pca9685_msg *msgs, int max);
+void pca9685_clean(struct pca9685 *dev, int addr, int len);
+
+void pca9685_get_stats(struct pca9685 *dev, struct pca9685_stats *stats);
+uint64_t pca9685_stats_percentile(const unsigned long *hist, int pct);
+void pca9685_print_stats(struct pca9685 *dev);
+
+#endif
@@ -0,0 +1,343 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pca9685_anim.h"
+
+#define NSEC 1000000000L
+
+struct pca9685_anim *pca9685_anim_open(const char *path, struct pca9685 **dev, int ndev)
+{
+	struct pca9685_anim *anim;
+	struct stat st;
+	int fd;
+
+	anim = calloc(1, sizeof(*anim));
+	if(anim == NULL)
+		return NULL;
+	anim->nch = ndev * LED_NUM;
+	anim->ch = calloc(anim->nch, sizeof(*anim->ch));
+	if(anim->ch == NULL){
+		free(anim);
+		return NULL;
+	}
+	anim->dev = dev;
+	anim->ndev = ndev;
+	anim->stats.jitter_min_ns = NSEC;
+
+	if((fd = open(path, O_RDONLY))<0){
+		printf("Failed to open %s\n", path);
+		goto err;
+	}
+	if(fstat(fd, &st) < 0){
+		close(fd);
+		goto err;
+	}
+	anim->size = st.st_size;
+	if(anim->size > 0){
+		anim->data = mmap(NULL, anim->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(anim->data == MAP_FAILED){
+			printf("Failed to mmap %s\n", path);
+			close(fd);
+			goto err;
+		}
+		// 앞에서부터 한 번만 읽어 나간다.
+		madvise((void *)anim->data, anim->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	return anim;
+
+err:
+	free(anim->ch);
+	free(anim);
+	return NULL;
+}
+
+void pca9685_anim_close(struct pca9685_anim *anim)
+{
+	if(anim == NULL)
+		return;
+	if(anim->size > 0)
+		munmap((void *)anim->data, anim->size);
+	free(anim->ch);
+	free(anim);
+}
+
+// 공백과 '#' 주석을 건너뛴다. 줄바꿈은 남긴다.
+static void skip_blank(struct pca9685_anim *anim, size_t *pos)
+{
+	while(*pos < anim->size){
+		char c = anim->data[*pos];
+
+		if(c == '#'){
+			while(*pos < anim->size && anim->data[*pos] != '\n')
+				(*pos)++;
+		}
+		else if(c == ' ' || c == '\t' || c == '\r')
+			(*pos)++;
+		else
+			return;
+	}
+}
+
+// mmap 영역은 NUL 로 끝나지 않으므로 strtoul 대신 직접 파싱한다.
+static int parse_uint(struct pca9685_anim *anim, size_t *pos, unsigned long *val)
+{
+	size_t start;
+
+	skip_blank(anim, pos);
+	start = *pos;
+	*val = 0;
+	while(*pos < anim->size && anim->data[*pos] >= '0' && anim->data[*pos] <= '9')
+		*val = *val * 10 + (anim->data[(*pos)++] - '0');
+	return *pos > start ? 0 : -1;
+}
+
+static void skip_line(struct pca9685_anim *anim, size_t *pos)
+{
+	while(*pos < anim->size && anim->data[(*pos)++] != '\n')
+		;
+}
+
+// *pos 에서부터 keyframe 하나를 읽는다. *line 은 그 줄의 시작. 파일 끝이면 -1
+// 잘못된 줄은 공용 파서(anim->pos)에서만 알린다.
+static int parse_key(struct pca9685_anim *anim, size_t *pos, size_t *line, struct anim_key *key, int *ch)
+{
+	unsigned long ms, c, value;
+
+	while(*pos < anim->size){
+		skip_blank(anim, pos);
+		if(*pos < anim->size && anim->data[*pos] == '\n'){
+			(*pos)++;
+			continue;
+		}
+		*line = *pos;
+		if(parse_uint(anim, pos, &ms) < 0 || parse_uint(anim, pos, &c) < 0 || parse_uint(anim, pos, &value) < 0){
+			if(pos == &anim->pos)
+				printf("bad keyframe at offset %zu\n", *pos);
+			skip_line(anim, pos);
+			continue;
+		}
+		skip_line(anim, pos);
+		if(c >= (unsigned long)anim->nch)
+			continue;
+		key->ms = ms;
+		key->value = value > DUTY_FULL ? DUTY_FULL : value;
+		*ch = c;
+		return 0;
+	}
+	return -1;
+}
+
+static void push_key(struct anim_chan *c, const struct anim_key *key)
+{
+	c->q[(c->head + c->count) % ANIM_QUEUE] = *key;
+	c->count++;
+}
+
+// now 까지 도달한 keyframe 을 큐에서 꺼내 직전 keyframe 으로 삼는다.
+static void advance(struct anim_chan *c, uint32_t now)
+{
+	while(c->count > 0 && c->q[c->head].ms <= now){
+		c->t0 = c->q[c->head].ms;
+		c->v0 = c->q[c->head].value;
+		c->active = 1;
+		c->head = (c->head + 1) % ANIM_QUEUE;
+		c->count--;
+	}
+}
+
+// 재생 중인데 큐에 now 뒤의 keyframe 이 없어 보간할 다음 값이 없다.
+static int starved(struct anim_chan *c, uint32_t now)
+{
+	if(c->count == 0)
+		return c->active;
+	return c->q[(c->head + c->count - 1) % ANIM_QUEUE].ms <= now;
+}
+
+// 큐가 차서 뒤처진 채널은 자기 위치에서 자기 keyframe 만 다시 읽는다.
+// 공용 파서 위치까지 따라잡으면 다시 공용 파서가 채운다.
+static void fill_chan(struct pca9685_anim *anim, int idx, uint32_t now)
+{
+	struct anim_chan *c = &anim->ch[idx];
+	size_t front = anim->has_pending ? anim->pending_pos : anim->pos;
+	size_t pos, line;
+	struct anim_key key;
+	int ch;
+
+	while(1){
+		if(c->count == ANIM_QUEUE)
+			advance(c, now);
+		if(c->count == ANIM_QUEUE)
+			return;
+		pos = c->pos;
+		if(parse_key(anim, &pos, &line, &key, &ch) < 0 || line >= front){
+			c->behind = 0;
+			return;
+		}
+		if(ch != idx){
+			c->pos = pos;
+			continue;
+		}
+		if(key.ms > now + ANIM_LOOKAHEAD_MS && !starved(c, now))
+			return;
+		push_key(c, &key);
+		c->pos = pos;
+	}
+}
+
+// now + ANIM_LOOKAHEAD_MS 까지의 keyframe 을 채널 큐에 채운다.
+// 재생 중인 채널의 큐가 비면 다음 keyframe 하나가 들어올 때까지 lookahead 를 넘어 읽는다.
+// 큐가 가득 찬 채널은 위치만 기억하고 건너뛰어 다른 채널을 막지 않는다.
+static void fill(struct pca9685_anim *anim, uint32_t now)
+{
+	struct anim_chan *c;
+	int i, was, need = 0;
+
+	for(i = 0; i < anim->nch; i++)
+		if(!anim->ch[i].behind && starved(&anim->ch[i], now))
+			need++;
+
+	while(1){
+		if(!anim->has_pending){
+			if(parse_key(anim, &anim->pos, &anim->pending_pos, &anim->pending, &anim->pending_ch) < 0)
+				break;
+			anim->has_pending = 1;
+		}
+		if(anim->pending.ms > now + ANIM_LOOKAHEAD_MS && need == 0)
+			break;
+		c = &anim->ch[anim->pending_ch];
+		was = !c->behind && starved(c, now);
+		if(c->count == ANIM_QUEUE)
+			advance(c, now);	// 이미 지난 keyframe 은 자리를 비워 준다
+		if(!c->behind && c->count == ANIM_QUEUE){
+			c->behind = 1;
+			c->pos = anim->pending_pos;
+		}
+		if(!c->behind)
+			push_key(c, &anim->pending);
+		need -= was - (!c->behind && starved(c, now));
+		anim->has_pending = 0;
+	}
+
+	for(i = 0; i < anim->nch; i++)
+		if(anim->ch[i].behind)
+			fill_chan(anim, i, now);
+}
+
+// 직전 keyframe 에서 다음 keyframe 까지 선형 보간한다. 값이 정해지지 않았으면 -1
+static int interpolate(struct anim_chan *c, uint32_t now)
+{
+	struct anim_key *next;
+
+	advance(c, now);
+	if(!c->active)
+		return -1;
+	if(c->count == 0)
+		return c->v0;
+	next = &c->q[c->head];
+	if(next->ms <= c->t0)	// 시간 순서가 어긋난 keyframe
+		return c->v0;
+	return c->v0 + ((int)next->value - c->v0) * (int64_t)(now - c->t0) / (next->ms - c->t0);
+}
+
+// ms 시점의 값을 모든 채널에 반영하고 프레임으로 보낸다(장치마다 commit, fleet 이면 전송 하나).
+// 재생이 끝났으면 1
+int pca9685_anim_frame(struct pca9685_anim *anim, uint32_t ms)
+{
+	int i, value, busy = 0;
+
+	fill(anim, ms);
+	for(i = 0; i < anim->nch; i++){
+		value = interpolate(&anim->ch[i], ms);
+		if(value >= 0)
+			pca9685_set_duty(anim->dev[i / LED_NUM], i % LED_NUM, value);
+		if(anim->ch[i].count > 0 || anim->ch[i].behind)
+			busy = 1;
+	}
+
+	if(anim->fleet){
+		if(pca9685_fleet_commit(anim->fleet) < 0)
+			return -1;
+	}
+	else{
+		for(i = 0; i < anim->ndev; i++)
+			if(pca9685_commit(anim->dev[i]) < 0)
+				return -1;
+	}
+	return !busy && !anim->has_pending && anim->pos >= anim->size;
+}
+
+static int64_t ts_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * NSEC + ts->tv_nsec;
+}
+
+// rate_hz 로 프레임을 돌린다. 프레임 시작 시각은 절대 시각으로 잡아 누적 오차가 없다.
+int pca9685_anim_run(struct pca9685_anim *anim, int rate_hz)
+{
+	struct timespec ts;
+	int64_t start, deadline, now, period;
+	int64_t frame = 0, late;
+	long jitter;
+	int i, ret;
+
+	if(rate_hz <= 0)
+		return -1;
+	period = NSEC / rate_hz;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = ts_ns(&ts);
+	while(1){
+		deadline = start + frame * period;
+		ts.tv_sec = deadline / NSEC;
+		ts.tv_nsec = deadline % NSEC;
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		jitter = ts_ns(&ts) - deadline;
+		if(jitter < anim->stats.jitter_min_ns)
+			anim->stats.jitter_min_ns = jitter;
+		if(jitter > anim->stats.jitter_max_ns)
+			anim->stats.jitter_max_ns = jitter;
+		anim->stats.jitter_sum_ns += jitter;
+
+		ret = pca9685_anim_frame(anim, (deadline - start) / 1000000);
+		anim->stats.frames++;
+		if(ret != 0)
+			return ret < 0 ? -1 : 0;
+
+		// 다음 프레임 시작 전에 끝나지 못했으면 miss, 이미 지나간 프레임은 건너뛴다.
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = ts_ns(&ts);
+		frame++;
+		if(now > start + frame * period){
+			anim->stats.misses++;
+			late = (now - start) / period + 1;
+			anim->stats.skipped += late - frame;
+			frame = late;
+		}
+		else{
+			// 남는 시간에 레지스터 파일 일부를 읽어 shadow 와 비교한다.
+			for(i = 0; i < anim->ndev; i++)
+				if(pca9685_check(anim->dev[i], period / 1000) < 0)
+					return -1;
+		}
+	}
+}
+
+void pca9685_anim_print_stats(struct pca9685_anim *anim)
+{
+	struct pca9685_anim_stats *st = &anim->stats;
+
+	printf("frames %lu, misses %lu, skipped %lu\n", st->frames, st->misses, st->skipped);
+	if(st->frames > 0)
+		printf("jitter min %ld ns, max %ld ns, avg %lld ns\n",
+				st->jitter_min_ns, st->jitter_max_ns, st->jitter_sum_ns / (long long)st->frames);
+}
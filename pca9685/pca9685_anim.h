@@ -0,0 +1,64 @@
+#ifndef PCA9685_ANIM_H
+#define PCA9685_ANIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pca9685.h"
+#include "pca9685_fleet.h"
+
+#define ANIM_QUEUE 8		// 채널마다 미리 읽어 두는 keyframe 수
+#define ANIM_LOOKAHEAD_MS 1000	// 이보다 먼 keyframe 은 아직 읽지 않는다
+#define ANIM_RATE 100		// 기본 프레임 속도 (Hz)
+
+struct anim_key {
+	uint32_t ms;
+	uint16_t value;
+};
+
+struct anim_chan {
+	int active;		// 첫 keyframe 에 도달했는지
+	uint32_t t0;		// 마지막으로 도달한 keyframe
+	uint16_t v0;
+	struct anim_key q[ANIM_QUEUE];
+	int head, count;
+	int behind;		// 큐가 차서 공용 파서가 이 채널을 건너뛰는 중
+	size_t pos;		// behind 일 때 이 채널이 다시 읽을 위치
+};
+
+struct pca9685_anim_stats {
+	unsigned long frames;
+	unsigned long misses;		// 프레임 주기 안에 flush 를 끝내지 못한 프레임
+	unsigned long skipped;		// 늦어서 건너뛴 프레임
+	long jitter_min_ns;		// 깨어난 시각 - 프레임 시작 시각
+	long jitter_max_ns;
+	long long jitter_sum_ns;
+};
+
+// keyframe 파일(한 줄에 "시각(ms) 채널 duty", '#' 주석)을 mmap 으로 읽으며 재생한다.
+// 채널 번호 c 는 dev[c / 16] 의 c % 16 번 채널이다.
+struct pca9685_anim {
+	const char *data;
+	size_t size;
+	size_t pos;
+	struct anim_key pending;
+	size_t pending_pos;	// pending 줄의 시작
+	int pending_ch;
+	int has_pending;
+
+	struct pca9685 **dev;
+	int ndev;
+	struct pca9685_fleet *fleet;	// 설정하면 프레임마다 fleet commit 한 번으로 보낸다
+	struct anim_chan *ch;
+	int nch;
+
+	struct pca9685_anim_stats stats;
+};
+
+struct pca9685_anim *pca9685_anim_open(const char *path, struct pca9685 **dev, int ndev);
+void pca9685_anim_close(struct pca9685_anim *anim);
+int pca9685_anim_frame(struct pca9685_anim *anim, uint32_t ms);
+int pca9685_anim_run(struct pca9685_anim *anim, int rate_hz);
+void pca9685_anim_print_stats(struct pca9685_anim *anim);
+
+#endif
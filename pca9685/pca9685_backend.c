@@ -0,0 +1,216 @@
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pca9685.h"
+
+// rw/smbus 는 I2C_SLAVE 로 묶인 주소로만 보낸다. 주소가 바뀔 때만 다시 묶는다.
+int pca9685_bind(struct pca9685 *dev, int addr)
+{
+	if(dev->slave == addr)
+		return 0;
+	dev->stats.syscalls++;
+	if(ioctl(dev->fd,I2C_SLAVE,addr)<0){
+		printf("Failed to acquire bus access and/or talk to slave\n");
+		dev->slave = -1;
+		return -1;
+	}
+	dev->slave = addr;
+	return 0;
+}
+
+//==========================================================
+// I2C_RDWR: 버스트마다 i2c_msg 하나(읽기는 레지스터 포인터 + 읽기 두 개)를 만들어
+// I2C_RDWR_IOCTL_MAX_MSGS 개씩 ioctl 한 번으로 보낸다. 메시지 사이는 repeated start
+//==========================================================
+static int rdwr_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n)
+{
+	struct i2c_msg im[I2C_RDWR_IOCTL_MAX_MSGS];
+	uint8_t buffer[I2C_RDWR_IOCTL_MAX_MSGS][1 + REG_FILE_SIZE];
+	struct i2c_rdwr_ioctl_data xfer;
+	int i = 0, cnt;
+
+	while(i < n){
+		for(cnt = 0; i < n && cnt + 1 + msgs[i].read <= I2C_RDWR_IOCTL_MAX_MSGS; i++){
+			buffer[cnt][0] = msgs[i].reg;
+			im[cnt].addr = msgs[i].addr;
+			im[cnt].flags = 0;
+			im[cnt].buf = buffer[cnt];
+			if(msgs[i].read){
+				im[cnt++].len = 1;
+				im[cnt].addr = msgs[i].addr;
+				im[cnt].flags = I2C_M_RD;
+				im[cnt].len = msgs[i].len;
+				im[cnt++].buf = msgs[i].buf;
+			}
+			else{
+				memcpy(&buffer[cnt][1], msgs[i].buf, msgs[i].len);
+				im[cnt++].len = msgs[i].len + 1;
+			}
+		}
+		xfer.msgs = im;
+		xfer.nmsgs = cnt;
+		dev->stats.syscalls++;
+		if(ioctl(dev->fd,I2C_RDWR,&xfer) != cnt)
+			return -1;
+	}
+	return 0;
+}
+
+const struct pca9685_backend pca9685_backend_rdwr = {
+	.name = "rdwr",
+	.funcs = I2C_FUNC_I2C,
+	.xfer = rdwr_xfer,
+};
+
+//==========================================================
+// write()/read(): 버스트마다 write 한 번. 읽기는 레지스터 포인터 write 후 read 라서
+// 사이에 STOP 이 들어간다. combined 전송을 못 하는 어댑터용
+//==========================================================
+static int rw_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n)
+{
+	uint8_t buffer[1 + REG_FILE_SIZE];
+	int i, len;
+
+	for(i = 0; i < n; i++){
+		if(pca9685_bind(dev, msgs[i].addr) < 0)
+			return -1;
+		buffer[0] = msgs[i].reg;
+		if(msgs[i].read){
+			dev->stats.syscalls += 2;
+			if(write(dev->fd,buffer,1) != 1)
+				return -1;
+			if(read(dev->fd,msgs[i].buf,msgs[i].len) != msgs[i].len)
+				return -1;
+		}
+		else{
+			len = msgs[i].len + 1;
+			memcpy(&buffer[1], msgs[i].buf, msgs[i].len);
+			dev->stats.syscalls++;
+			if(write(dev->fd,buffer,len) != len)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+const struct pca9685_backend pca9685_backend_rw = {
+	.name = "rw",
+	.funcs = I2C_FUNC_I2C,
+	.xfer = rw_xfer,
+};
+
+//==========================================================
+// I2C_SMBUS: SMBus 어댑터(i2c-stub 포함)용. SMBus block write 는 바이트 수를
+// 데이터 앞에 실어 보내 PCA9685 가 그것을 레지스터 값으로 받아들이므로,
+// 바이트 수 없이 보내는 I2C block 을 32바이트씩 나누어 쓴다.
+// I2C block 이 없으면 byte data 로 한 바이트씩 보낸다.
+//==========================================================
+static int smbus_access(struct pca9685 *dev, char rw, uint8_t cmd, int size, union i2c_smbus_data *data)
+{
+	struct i2c_smbus_ioctl_data args;
+
+	args.read_write = rw;
+	args.command = cmd;
+	args.size = size;
+	args.data = data;
+	dev->stats.syscalls++;
+	return ioctl(dev->fd,I2C_SMBUS,&args);
+}
+
+static int smbus_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n)
+{
+	union i2c_smbus_data data;
+	unsigned long need;
+	int i, off, len, max;
+
+	for(i = 0; i < n; i++){
+		if(pca9685_bind(dev, msgs[i].addr) < 0)
+			return -1;
+		need = msgs[i].read ? I2C_FUNC_SMBUS_READ_I2C_BLOCK : I2C_FUNC_SMBUS_WRITE_I2C_BLOCK;
+		max = (dev->funcs & need) ? I2C_SMBUS_BLOCK_MAX : 1;
+
+		// AI 가 켜져 있으므로 조각마다 시작 레지스터만 옮긴다.
+		for(off = 0; off < msgs[i].len; off += len){
+			len = msgs[i].len - off;
+			if(len > max)
+				len = max;
+			if(msgs[i].read){
+				if(len == 1){
+					if(smbus_access(dev, I2C_SMBUS_READ, msgs[i].reg + off, I2C_SMBUS_BYTE_DATA, &data) < 0)
+						return -1;
+					msgs[i].buf[off] = data.byte;
+				}
+				else{
+					data.block[0] = len;
+					if(smbus_access(dev, I2C_SMBUS_READ, msgs[i].reg + off, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0 ||
+							data.block[0] != len)
+						return -1;
+					memcpy(&msgs[i].buf[off], &data.block[1], len);
+				}
+			}
+			else{
+				if(len == 1){
+					data.byte = msgs[i].buf[off];
+					if(smbus_access(dev, I2C_SMBUS_WRITE, msgs[i].reg + off, I2C_SMBUS_BYTE_DATA, &data) < 0)
+						return -1;
+				}
+				else{
+					data.block[0] = len;
+					memcpy(&data.block[1], &msgs[i].buf[off], len);
+					if(smbus_access(dev, I2C_SMBUS_WRITE, msgs[i].reg + off, I2C_SMBUS_I2C_BLOCK_DATA, &data) < 0)
+						return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+const struct pca9685_backend pca9685_backend_smbus = {
+	.name = "smbus",
+	.funcs = I2C_FUNC_SMBUS_BYTE_DATA,
+	.xfer = smbus_xfer,
+};
+
+// 빠른 순서. 앞에서부터 어댑터가 지원하는 첫 backend 를 고른다.
+static const struct pca9685_backend *backends[] = {
+	&pca9685_backend_rdwr,
+	&pca9685_backend_rw,
+	&pca9685_backend_smbus,
+};
+
+#define NBACKEND (sizeof(backends) / sizeof(backends[0]))
+
+const struct pca9685_backend *pca9685_probe(unsigned long funcs)
+{
+	size_t i;
+
+	for(i = 0; i < NBACKEND; i++)
+		if((funcs & backends[i]->funcs) == backends[i]->funcs)
+			return backends[i];
+	return NULL;
+}
+
+// 이름으로 backend 를 고정한다. 어댑터가 지원하지 않으면 -1
+int pca9685_set_backend(struct pca9685 *dev, const char *name)
+{
+	size_t i;
+
+	for(i = 0; i < NBACKEND; i++){
+		if(strcmp(name, backends[i]->name))
+			continue;
+		if((dev->funcs & backends[i]->funcs) != backends[i]->funcs){
+			printf("Adapter does not support %s backend\n", name);
+			return -1;
+		}
+		dev->backend = backends[i];
+		return 0;
+	}
+	printf("Unknown backend : %s\n", name);
+	return -1;
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "pca9685.h"
+#include "pca9685_fleet.h"
+#include "pca9685_map.h"
+#include "pca9685_sim.h"
+
+#define BENCH_ITER 100000	// 모드마다 갱신 횟수
+#define BENCH_BOARDS 4		// fleet 모드 보드 수
+#define BENCH_BUS_HZ 400000	// fleet 프레임 예산 계산용 (fast mode)
+
+struct bench_result {
+	const char *mode;
+	long updates;
+	double elapsed;		// 초
+	unsigned long bytes;	// 레지스터 포인터 포함 tx + rx
+	unsigned long wire;	// sim 만: 주소 바이트까지 포함
+	unsigned long syscalls;
+	unsigned long deferred;	// fleet 만: 프레임 예산을 넘어 미뤄진 보드
+	uint64_t p50, p99, p999;
+	int failed;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void percentiles(struct bench_result *r, uint64_t *lat, long n)
+{
+	if(n == 0)
+		return;
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+	r->p50 = lat[n * 50 / 100];
+	r->p99 = lat[n * 99 / 100];
+	r->p999 = lat[n * 999 / 1000];
+}
+
+// 매번 값이 바뀌어 dirty 가 생기도록 full on/off 를 피한 duty
+static int bench_duty(long i, int ch)
+{
+	return (i * 97 + ch * 251) % 4000 + 50;
+}
+
+static unsigned long sim_wire(struct pca9685 *dev)
+{
+	struct pca9685_sim *sim;
+
+	if(dev->backend != &pca9685_backend_sim)
+		return 0;
+	sim = dev->priv;
+	return sim->wire_bytes;
+}
+
+// 보드 하나를 대상으로 mode 에 맞는 갱신을 iter 번 하고 잰다.
+static void bench_dev(struct pca9685 *dev, const char *mode, long iter, uint64_t *lat, struct bench_result *r)
+{
+	uint16_t duty[LED_NUM];
+	uint8_t regs[REG_FILE_SIZE];
+	unsigned long wire0 = sim_wire(dev);
+	uint64_t t0, t;
+	long i;
+	int ch, ret = 0;
+
+	memset(&dev->stats, 0, sizeof(dev->stats));
+	memset(r, 0, sizeof(*r));
+	r->mode = mode;
+	dev->verify_every = !strcmp(mode, "verify");
+
+	t0 = now_ns();
+	for(i = 0; i < iter && ret >= 0; i++){
+		t = now_ns();
+		if(!strcmp(mode, "single")){
+			pca9685_set_duty(dev, i % LED_NUM, bench_duty(i, i % LED_NUM));
+			ret = pca9685_flush(dev);
+		}
+		else if(!strcmp(mode, "commit")){
+			// board 와 같은 갱신을 STOP 한 번에 반영되는 프레임으로 보낸다.
+			for(ch = 0; ch < LED_NUM; ch++)
+				duty[ch] = bench_duty(i, ch);
+			pca9685_set_duty_all(dev, duty);
+			ret = pca9685_commit(dev);
+		}
+		else if(!strcmp(mode, "dump"))
+			ret = pca9685_dump(dev, regs);
+		else if(!strcmp(mode, "bright")){
+			// 16bit 밝기 -> gamma -> 레지스터 패킹까지 포함한 전체 보드 갱신
+			for(ch = 0; ch < LED_NUM; ch++)
+				duty[ch] = bench_duty(i, ch) * 16;
+			pca9685_set_brightness16(dev, duty);
+			ret = pca9685_flush(dev);
+		}
+		else{
+			for(ch = 0; ch < LED_NUM; ch++)
+				duty[ch] = bench_duty(i, ch);
+			pca9685_set_duty_all(dev, duty);
+			ret = pca9685_flush(dev);
+		}
+		lat[i] = now_ns() - t;
+	}
+	r->elapsed = (now_ns() - t0) / 1e9;
+	r->updates = i;
+	r->failed = ret < 0;
+	r->bytes = dev->stats.tx_bytes + dev->stats.rx_bytes;
+	r->wire = sim_wire(dev) - wire0;
+	r->syscalls = dev->stats.syscalls;
+	dev->verify_every = 0;
+	percentiles(r, lat, i);
+}
+
+// nboard 개 보드의 16채널을 모두 바꾸고 fleet flush(commit 이면 fleet commit) 한 번을 갱신 하나로 센다.
+static void bench_fleet(const char *bus, int addr, int nboard, int commit, long iter, uint64_t *lat, struct bench_result *r)
+{
+	struct pca9685_fleet *fleet;
+	struct pca9685 *dev;
+	unsigned long wire0;
+	uint64_t t0, t;
+	long i;
+	int b, ch, ret = 0;
+
+	memset(r, 0, sizeof(*r));
+	r->mode = commit ? "fleet_commit" : "fleet";
+	r->failed = 1;
+	fleet = pca9685_fleet_open(bus);
+	if(fleet == NULL)
+		return;
+	for(b = 0; b < nboard; b++){
+		if(pca9685_fleet_add(fleet, addr + b) < 0 || pca9685_init(fleet->board[b]) < 0){
+			pca9685_fleet_close(fleet);
+			return;
+		}
+	}
+	fleet->bus_hz = BENCH_BUS_HZ;
+	memset(&fleet->io->stats, 0, sizeof(fleet->io->stats));
+	wire0 = sim_wire(fleet->io);
+
+	t0 = now_ns();
+	for(i = 0; i < iter && ret >= 0; i++){
+		t = now_ns();
+		for(b = 0; b < nboard; b++){
+			dev = fleet->board[b];
+			for(ch = 0; ch < LED_NUM; ch++)
+				pca9685_set_duty(dev, ch, bench_duty(i + b, ch));
+		}
+		if(commit)
+			ret = pca9685_fleet_commit(fleet);
+		else if((ret = pca9685_fleet_flush(fleet)) > 0)
+			r->deferred += ret;
+		lat[i] = now_ns() - t;
+	}
+	r->elapsed = (now_ns() - t0) / 1e9;
+	r->updates = i;
+	r->failed = ret < 0;
+	r->bytes = fleet->io->stats.tx_bytes + fleet->io->stats.rx_bytes;
+	r->wire = sim_wire(fleet->io) - wire0;
+	r->syscalls = fleet->io->stats.syscalls;
+	percentiles(r, lat, i);
+	pca9685_fleet_close(fleet);
+}
+
+static void print_result(struct bench_result *r, int last)
+{
+	double n = r->updates ? r->updates : 1;
+
+	printf("    {\"mode\": \"%s\", \"updates\": %ld, \"failed\": %s, ", r->mode, r->updates, r->failed ? "true" : "false");
+	printf("\"updates_per_sec\": %.0f, ", r->elapsed > 0 ? r->updates / r->elapsed : 0);
+	printf("\"bytes_per_update\": %.2f, \"wire_bytes_per_update\": %.2f, ", r->bytes / n, r->wire / n);
+	printf("\"syscalls_per_update\": %.3f, \"deferred_per_update\": %.3f, ", r->syscalls / n, r->deferred / n);
+	printf("\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}%s\n",
+			(unsigned long long)r->p50, (unsigned long long)r->p99, (unsigned long long)r->p999, last ? "" : ",");
+}
+
+static void usage(const char *name)
+{
+	printf("Usage : %s [-b bus|sim] [-a addr] [-B rdwr|rw|smbus] [-n iterations] [-N fleet_boards]\n", name);
+}
+
+// 결과는 JSON 한 덩어리로 stdout 에 낸다. 릴리스마다 저장해 두고 비교한다.
+int main(int argc, char **argv)
+{
+	static const char *modes[] = { "single", "board", "commit", "bright", "verify", "dump" };
+	struct bench_result r[8];
+	const char *bus = SIM_PREFIX, *backend = NULL;
+	struct pca9685 *dev;
+	uint64_t *lat;
+	long iter = BENCH_ITER;
+	int addr = PCA9685_ADDR, nboard = BENCH_BOARDS, opt, i, n = 0;
+
+	while((opt = getopt(argc, argv, "b:a:B:n:N:")) != -1){
+		switch(opt){
+		case 'b':
+			bus = optarg;
+			break;
+		case 'a':
+			addr = strtol(optarg, NULL, 0);
+			break;
+		case 'B':
+			backend = optarg;
+			break;
+		case 'n':
+			iter = atol(optarg);
+			break;
+		case 'N':
+			nboard = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if(iter <= 0 || nboard < 0 || nboard > FLEET_MAX){
+		usage(argv[0]);
+		return -1;
+	}
+
+	lat = malloc(iter * sizeof(*lat));
+	dev = pca9685_open(bus, addr);
+	if(lat == NULL || dev == NULL)
+		return -1;
+	if((backend && pca9685_set_backend(dev, backend) < 0) || pca9685_init(dev) < 0){
+		pca9685_close(dev);
+		return -1;
+	}
+
+	for(i = 0; i < 6; i++)
+		bench_dev(dev, modes[i], iter, lat, &r[n++]);
+	// fleet 는 addr 다음 주소부터 보드를 붙인다.
+	if(nboard > 0){
+		bench_fleet(bus, addr + 1, nboard, 0, iter, lat, &r[n++]);
+		bench_fleet(bus, addr + 1, nboard, 1, iter, lat, &r[n++]);
+	}
+
+	printf("{\n  \"bus\": \"%s\", \"backend\": \"%s\", \"iterations\": %ld, \"fleet_boards\": %d,\n",
+			bus, dev->backend->name, iter, nboard);
+	printf("  \"results\": [\n");
+	for(i = 0; i < n; i++)
+		print_result(&r[i], i == n - 1);
+	printf("  ]\n}\n");
+
+	pca9685_close(dev);
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "pca9685.h"
+#include "pca9685_anim.h"
+#include "pca9685_map.h"
+#include "pca9685_shm.h"
+
+ //#define LED8_ON_L 0x26
+ #define LED8_ON_L 0x06
+#define LED_CH ((LED8_ON_L - LED0_ON_L) / 4)
+
+#define CTL_SOCK "/tmp/pca9685.sock"	// 로컬 제어 소켓 (datagram 한 개 = 명령 한 줄)
+
+#define LEVEL_STEP 4	// 키 한 번에 바뀌는 밝기 (0 ~ 255, gamma 보정)
+
+struct led_state {
+	int level;	// 체감 밝기. gamma 표로 tick 으로 바꾼다
+	int pending;	// 다음 프레임에 flush 할 변경이 있는지
+};
+
+static void key_input(struct pca9685 *dev, struct led_state *st, char key)
+{
+	int level;
+
+	// 끝까지 한 칸이 모자라도 끝(0, 255)까지는 간다. 이미 끝이면 알린다.
+	if(key == 'a')
+		level = st->level + LEVEL_STEP < GAMMA_LEVELS ? st->level + LEVEL_STEP : GAMMA_LEVELS - 1;
+	else if(key == 's')
+		level = st->level - LEVEL_STEP >= 0 ? st->level - LEVEL_STEP : 0;
+	else
+		return;
+	if(level == st->level){
+		printf("값 초과\n");
+		return;
+	}
+	st->level = level;
+	// shadow 만 바꾸고 버스 전송은 프레임 tick 에서 한 번에 한다.
+	pca9685_set_duty(dev, LED_CH, pca9685_gamma8[st->level]);
+	st->pending = 1;
+}
+
+// "duty <ch> <duty>", "led <ch> <on> <off>", "bright <ch> <level 0~255>", "quit"
+static int sock_input(struct pca9685 *dev, struct led_state *st, char *cmd)
+{
+	int ch, a, b;
+
+	if(sscanf(cmd, "duty %d %d", &ch, &a) == 2)
+		pca9685_set_duty(dev, ch, a);
+	else if(sscanf(cmd, "led %d %d %d", &ch, &a, &b) == 3)
+		pca9685_led_set(dev, ch, a, b);
+	else if(sscanf(cmd, "bright %d %d", &ch, &a) == 2 && a >= 0 && a < GAMMA_LEVELS)
+		pca9685_set_duty(dev, ch, pca9685_gamma8[a]);
+	else if(!strncmp(cmd, "quit", 4))
+		return 1;
+	else{
+		printf("unknown command : %s\n", cmd);
+		return 0;
+	}
+	st->pending = 1;
+	return 0;
+}
+
+static int ctl_socket(void)
+{
+	struct sockaddr_un sun;
+	int sock;
+
+	sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if(sock < 0)
+		return -1;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", CTL_SOCK);
+	unlink(CTL_SOCK);
+	if(bind(sock, (struct sockaddr *)&sun, sizeof(sun)) < 0){
+		printf("Failed to bind %s\n", CTL_SOCK);
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+// stdin, 프레임 timerfd, 제어 소켓을 epoll 로 함께 기다린다.
+// 키 입력과 소켓 명령은 shadow 에만 반영되고, 프레임마다 변경이 있을 때만 flush 한 번을 보낸다.
+// 프레임마다 dev->check_pct 만큼의 버스 시간으로 무결성 검사를 한다.
+// stats_sec 가 0 이 아니면 그 주기로 장치 통계를 출력한다.
+int led_on(struct pca9685 *dev, int rate, int stats_sec)
+{
+	struct led_state st = { 188, 0 };
+	struct epoll_event ev, events[8];
+	struct itimerspec its;
+	struct termios old_tio, tio;
+	uint64_t ticks;
+	char buf[128];
+	int epfd, tfd, sfd = -1, sock, n, i, j, len, quit = 0, tty;
+
+	if(rate <= 0)
+		return -1;
+	epfd = epoll_create1(0);
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if(epfd < 0 || tfd < 0){
+		printf("Failed to create epoll/timerfd\n");
+		return -1;
+	}
+	its.it_interval.tv_sec = rate == 1;
+	its.it_interval.tv_nsec = rate == 1 ? 0 : 1000000000L / rate;
+	its.it_value = its.it_interval;
+	timerfd_settime(tfd, 0, &its, NULL);
+	if(stats_sec > 0 && (sfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) >= 0){
+		its.it_interval.tv_sec = stats_sec;
+		its.it_interval.tv_nsec = 0;
+		its.it_value = its.it_interval;
+		timerfd_settime(sfd, 0, &its, NULL);
+	}
+	sock = ctl_socket();
+
+	// 키를 누르는 즉시 읽도록 canonical 모드를 끈다.
+	tty = tcgetattr(STDIN_FILENO, &old_tio) == 0;
+	if(tty){
+		tio = old_tio;
+		tio.c_lflag &= ~(ICANON | ECHO);
+		tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.fd = STDIN_FILENO;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+	ev.data.fd = tfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+	if(sock >= 0){
+		ev.data.fd = sock;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev);
+	}
+	if(sfd >= 0){
+		ev.data.fd = sfd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+	}
+
+	printf("key insert (a/s, c = quit) :\n");
+	while(!quit){
+		n = epoll_wait(epfd, events, 8, -1);
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		for(i = 0; i < n; i++){
+			if(events[i].data.fd == STDIN_FILENO){
+				// 키를 누르고 있어 여러 글자가 쌓였어도 한 번에 읽어 처리한다.
+				len = read(STDIN_FILENO, buf, sizeof(buf));
+				if(len <= 0)
+					quit = 1;
+				for(j = 0; j < len && !quit; j++){
+					if(buf[j] == 'c')
+						quit = 1;
+					else
+						key_input(dev, &st, buf[j]);
+				}
+			}
+			else if(events[i].data.fd == sock){
+				while((len = recv(sock, buf, sizeof(buf) - 1, 0)) > 0 && !quit){
+					buf[len] = '\0';
+					quit = sock_input(dev, &st, buf);
+				}
+			}
+			else if(events[i].data.fd == tfd){
+				if(read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks))
+					continue;
+				if(st.pending){
+					if(pca9685_flush(dev) < 0)
+						quit = 1;
+					st.pending = 0;
+					printf("level = %d, duty = %d\n", st.level, pca9685_gamma8[st.level]);
+				}
+				// 남는 버스 시간에 레지스터 파일 일부를 읽어 shadow 와 비교한다.
+				if(!quit && pca9685_check(dev, 1000000L / rate) < 0)
+					quit = 1;
+			}
+			else if(events[i].data.fd == sfd){
+				if(read(sfd, &ticks, sizeof(ticks)) == sizeof(ticks))
+					pca9685_print_stats(dev);
+			}
+		}
+	}
+
+	// 종료 전에 남은 변경을 보낸다.
+	if(st.pending && pca9685_flush(dev) < 0)
+		printf("Failed to flush pending changes\n");
+	if(tty)
+		tcsetattr(STDIN_FILENO, TCSANOW, &old_tio);
+	if(sock >= 0){
+		close(sock);
+		unlink(CTL_SOCK);
+	}
+	if(sfd >= 0)
+		close(sfd);
+	close(tfd);
+	close(epfd);
+	return 0;
+}
+
+// keyframe 파일을 rate Hz 로 재생한다.
+static int play(struct pca9685 *dev, const char *path, int rate)
+{
+	struct pca9685_anim *anim;
+	int ret;
+
+	anim = pca9685_anim_open(path, &dev, 1);
+	if(anim == NULL)
+		return -1;
+	ret = pca9685_anim_run(anim, rate);
+	pca9685_anim_print_stats(anim);
+	pca9685_anim_close(anim);
+	return ret;
+}
+
+static volatile sig_atomic_t stop;
+
+static void stop_handler(int signum)
+{
+	(void)signum;
+	stop = 1;
+}
+
+// 공유 메모리 setpoint 테이블을 만들고 rate Hz 로 버스에 반영한다.
+static int daemon_run(struct pca9685 *dev, int rate, int stats_sec)
+{
+	struct pca9685_shm *shm;
+	int ret;
+
+	shm = pca9685_shm_create(SHM_NAME, 1, rate);
+	if(shm == NULL)
+		return -1;
+	signal(SIGINT, stop_handler);
+	signal(SIGTERM, stop_handler);
+	printf("setpoint table %s ready\n", SHM_NAME);
+	ret = pca9685_shm_run(shm, &dev, 1, stats_sec, &stop);
+	pca9685_shm_close(shm);
+	return ret;
+}
+
+// "board:ch:duty" 를 데몬의 테이블에 써 넣는다. 버스는 열지 않는다.
+static int shm_set(const char *arg)
+{
+	struct pca9685_shm *shm;
+	int board, ch, duty, ret;
+
+	if(sscanf(arg, "%d:%d:%d", &board, &ch, &duty) != 3){
+		printf("bad setpoint : %s\n", arg);
+		return -1;
+	}
+	shm = pca9685_shm_attach(SHM_NAME);
+	if(shm == NULL)
+		return -1;
+	ret = pca9685_shm_set(shm, board, ch, duty);
+	pca9685_shm_close(shm);
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage : %s [-b bus] [-a addr] [-B rdwr|rw|smbus] [-f freq] [-v verify_every] [-c check_pct] [-p keyframe_file] [-r frame_rate] [-S stats_sec] [-D]\n", name);
+	printf("        %s -s board:ch:duty\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	const char *bus = PCA9685_BUS;
+	const char *play_file = NULL;
+	const char *backend = NULL;
+	int addr = PCA9685_ADDR, verify_every = 0, freq = 100, rate = ANIM_RATE, opt, ret = 0;
+	int daemon_mode = 0, stats_sec = 0, check_pct = CHECK_PCT;
+	uint32_t actual;
+	struct pca9685 *dev;
+
+	while((opt = getopt(argc, argv, "b:a:B:f:v:c:p:r:S:Ds:")) != -1){
+		switch(opt){
+		case 'b':
+			bus = optarg;
+			break;
+		case 'a':
+			addr = strtol(optarg, NULL, 0);
+			break;
+		case 'B':
+			backend = optarg;
+			break;
+		case 'f':
+			freq = atoi(optarg);
+			break;
+		case 'v':
+			verify_every = atoi(optarg);
+			break;
+		case 'c':
+			check_pct = atoi(optarg);
+			break;
+		case 'p':
+			play_file = optarg;
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'S':
+			stats_sec = atoi(optarg);
+			break;
+		case 'D':
+			daemon_mode = 1;
+			break;
+		case 's':
+			return shm_set(optarg);
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	dev = pca9685_open(bus, addr);
+	if(dev == NULL)
+		return -1;
+	dev->verify_every = verify_every;
+	dev->check_pct = check_pct;
+	if(backend && pca9685_set_backend(dev, backend) < 0){
+		pca9685_close(dev);
+		return -1;
+	}
+	printf("backend = %s\n", dev->backend->name);
+
+	if(pca9685_init(dev) < 0 || pca9685_set_frequency(dev, freq, &actual) < 0){
+		pca9685_close(dev);
+		return -1;
+	}
+	printf("freq = %u.%03u Hz\n", actual / 1000, actual % 1000);
+	if(daemon_mode)
+		ret = daemon_run(dev, rate, stats_sec);
+	else if(play_file)
+		ret = play(dev, play_file, rate);
+	else
+		ret = led_on(dev, rate, stats_sec);
+
+	if(stats_sec > 0)
+		pca9685_print_stats(dev);
+	pca9685_close(dev);
+	return ret;
+}
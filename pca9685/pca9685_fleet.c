@@ -0,0 +1,352 @@
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pca9685_fleet.h"
+
+// flush 에서 backend 에 한 번에 넘기는 메시지 수 (rdwr 이면 ioctl 한 번)
+#define FLEET_MSGS I2C_RDWR_IOCTL_MAX_MSGS
+
+// 버스트 하나가 버스를 점유하는 시간(us): 주소 + 레지스터 + 데이터, 바이트당 9bit
+#define BURST_US(fleet, len) (((len) + 2) * 9 * 1000000L / (fleet)->bus_hz)
+
+struct pca9685_fleet *pca9685_fleet_open(const char *bus)
+{
+	struct pca9685_fleet *fleet;
+
+	fleet = calloc(1, sizeof(*fleet));
+	if(fleet == NULL)
+		return NULL;
+
+	// 메시지마다 주소를 따로 싣는다. rw/smbus backend 는 주소가 바뀔 때만 I2C_SLAVE 를 다시 묶는다.
+	fleet->io = pca9685_open(bus, ALLCALL_ADDR);
+	if(fleet->io == NULL){
+		free(fleet);
+		return NULL;
+	}
+	snprintf(fleet->bus, sizeof(fleet->bus), "%s", bus);
+	fleet->bus_hz = BUS_HZ;
+	fleet->frame_us = FRAME_US;
+	return fleet;
+}
+
+void pca9685_fleet_close(struct pca9685_fleet *fleet)
+{
+	int i;
+
+	if(fleet == NULL)
+		return;
+	for(i = 0; i < fleet->nboard; i++)
+		pca9685_close(fleet->board[i]);
+	pca9685_close(fleet->io);
+	free(fleet);
+}
+
+// 보드를 추가하고 fleet 안의 번호를 돌려준다.
+int pca9685_fleet_add(struct pca9685_fleet *fleet, int addr)
+{
+	struct pca9685 *dev;
+
+	if(fleet->nboard >= FLEET_MAX)
+		return -1;
+	dev = pca9685_open(fleet->bus, addr);
+	if(dev == NULL)
+		return -1;
+	fleet->board[fleet->nboard] = dev;
+	return fleet->nboard++;
+}
+
+static int is_member(struct pca9685_fleet *fleet, int group, int i)
+{
+	if(group == FLEET_ALLCALL)
+		return fleet->board[i]->shadow[MODE1] & MODE1_ALLCALL;
+	return (fleet->group_mask[group] >> i) & 1;
+}
+
+// broadcast 로 칩에 들어간 값을 보드 shadow 에 맞춘다.
+// ALL_LED_* 레지스터는 모든 LEDn 의 같은 위치 레지스터에 들어간다.
+static void shadow_apply(struct pca9685 *dev, int reg, const uint8_t *data, int len)
+{
+	int i, ch, r;
+
+	for(i = 0; i < len; i++){
+		r = reg + i;
+		if(r >= ALL_LED_ON_L && r <= ALL_LED_OFF_H){
+			for(ch = 0; ch < LED_NUM; ch++){
+				dev->shadow[LED_REG(ch) + r - ALL_LED_ON_L] = data[i];
+				pca9685_clean(dev, LED_REG(ch) + r - ALL_LED_ON_L, 1);
+			}
+		}
+		else if(r < REG_NUM){
+			dev->shadow[r] = data[i];
+			pca9685_clean(dev, r, 1);
+		}
+	}
+}
+
+// ALLCALL(group = FLEET_ALLCALL) 이나 SUBADRn 으로 전송 한 번에 모든 멤버에게 쓴다.
+int pca9685_fleet_broadcast(struct pca9685_fleet *fleet, int group, int reg, const uint8_t *data, int len)
+{
+	struct pca9685_msg msg;
+	int i;
+
+	if(len <= 0 || len > REG_FILE_SIZE)
+		return -1;
+	if(group != FLEET_ALLCALL && (group < 0 || group >= FLEET_GROUPS || fleet->group_addr[group] == 0))
+		return -1;
+
+	msg.addr = group == FLEET_ALLCALL ? ALLCALL_ADDR : fleet->group_addr[group];
+	msg.reg = reg;
+	msg.read = 0;
+	msg.len = len;
+	msg.buf = (uint8_t *)data;
+	if(pca9685_xfer(fleet->io, &msg, 1) < 0)
+		return -1;
+
+	for(i = 0; i < fleet->nboard; i++)
+		if(is_member(fleet, group, i))
+			shadow_apply(fleet->board[i], reg, data, len);
+	return 0;
+}
+
+// 보드들을 SUBADRn 그룹으로 묶는다. mask 의 bit i 가 board[i] 이다.
+int pca9685_fleet_set_group(struct pca9685_fleet *fleet, int group, int addr, uint64_t mask)
+{
+	uint8_t mode1, subadr = addr << 1;
+	uint8_t sub = MODE1_SUB1 >> group;
+	int i;
+
+	if(group < 0 || group >= FLEET_GROUPS)
+		return -1;
+
+	for(i = 0; i < fleet->nboard; i++){
+		mode1 = fleet->board[i]->shadow[MODE1] & ~sub;
+		if((mask >> i) & 1)
+			mode1 |= sub;
+		pca9685_set(fleet->board[i], SUBADR1 + group, &subadr, 1);
+		pca9685_set(fleet->board[i], MODE1, &mode1, 1);
+		if(pca9685_flush(fleet->board[i]) < 0)
+			return -1;
+	}
+	fleet->group_addr[group] = addr;
+	fleet->group_mask[group] = mask;
+	return 0;
+}
+
+// 레지스터 reg 에 보드마다 val[i] 를 쓴다. 값이 모두 같고 모든 보드가 ALLCALL 을 받으면
+// ALLCALL 한 번, 아니면 보드별 메시지를 전송 한 번에 보낸다.
+static int fleet_write_each(struct pca9685_fleet *fleet, int reg, uint8_t *val)
+{
+	struct pca9685_msg msgs[FLEET_MAX];
+	int i, same = 1;
+
+	if(fleet->nboard == 0)
+		return 0;
+	for(i = 0; i < fleet->nboard; i++)
+		if(val[i] != val[0] || !is_member(fleet, FLEET_ALLCALL, i))
+			same = 0;
+	if(same)
+		return pca9685_fleet_broadcast(fleet, FLEET_ALLCALL, reg, &val[0], 1);
+
+	for(i = 0; i < fleet->nboard; i++){
+		msgs[i].addr = fleet->board[i]->addr;
+		msgs[i].reg = reg;
+		msgs[i].read = 0;
+		msgs[i].len = 1;
+		msgs[i].buf = &val[i];
+	}
+	if(pca9685_xfer(fleet->io, msgs, fleet->nboard) < 0)
+		return -1;
+	for(i = 0; i < fleet->nboard; i++)
+		shadow_apply(fleet->board[i], reg, &val[i], 1);
+	return 0;
+}
+
+// MODE1 을 바꾼다. SUBn 비트가 보드마다 달라 값이 다를 수 있다.
+static int fleet_mode1(struct pca9685_fleet *fleet, uint8_t set, uint8_t clr)
+{
+	uint8_t mode1[FLEET_MAX];
+	int i;
+
+	for(i = 0; i < fleet->nboard; i++)
+		mode1[i] = (fleet->board[i]->shadow[MODE1] & ~clr) | set;
+	return fleet_write_each(fleet, MODE1, mode1);
+}
+
+// 모든 보드의 주파수를 pca9685_set_frequency() 와 같은 순서로 바꾼다.
+// PRE_SCALE 과 MODE1 은 모든 보드가 ALLCALL 을 받고 값이 같으면 ALLCALL 한 번으로 보낸다.
+int pca9685_fleet_set_frequency(struct pca9685_fleet *fleet, int hz, uint32_t *actual_millihz)
+{
+	uint8_t prescale = pca9685_prescale(hz), pre[FLEET_MAX];
+	int i, same = 1;
+
+	for(i = 0; i < fleet->nboard; i++)
+		if(fleet->board[i]->shadow[PRE_SCALE] != prescale)
+			same = 0;
+
+	if(!same){
+		if(fleet_mode1(fleet, MODE1_SLEEP | MODE1_AI, MODE1_RESTART) < 0)
+			return -1;
+		memset(pre, prescale, sizeof(pre));
+		if(fleet_write_each(fleet, PRE_SCALE, pre) < 0)
+			return -1;
+		if(fleet_mode1(fleet, 0, MODE1_SLEEP) < 0)
+			return -1;
+		pca9685_osc_settle();
+		if(fleet_mode1(fleet, MODE1_RESTART, 0) < 0)
+			return -1;
+		// RESTART 비트는 쓰고 나면 칩이 스스로 지우므로 shadow 에는 남기지 않는다.
+		for(i = 0; i < fleet->nboard; i++)
+			fleet->board[i]->shadow[MODE1] &= ~MODE1_RESTART;
+	}
+	if(actual_millihz)
+		*actual_millihz = pca9685_prescale_millihz(prescale);
+	return 0;
+}
+
+// ALL_LED_OFF_H 의 full off 비트로 모든 보드의 모든 채널을 끈다.
+int pca9685_fleet_all_off(struct pca9685_fleet *fleet)
+{
+	uint8_t data[4] = { 0, 0, 0, 0x10 };
+
+	return pca9685_fleet_broadcast(fleet, FLEET_ALLCALL, ALL_LED_ON_L, data, 4);
+}
+
+int pca9685_fleet_group_led(struct pca9685_fleet *fleet, int group, int ch, int on, int off)
+{
+	uint8_t data[4];
+
+	if(ch < 0 || ch >= LED_NUM)
+		return -1;
+	data[0] = on & 0xff;
+	data[1] = (on >> 8) & 0x1f;
+	data[2] = off & 0xff;
+	data[3] = (off >> 8) & 0x1f;
+	return pca9685_fleet_broadcast(fleet, group, LED_REG(ch), data, 4);
+}
+
+static int fleet_send(struct pca9685_fleet *fleet, struct pca9685_msg *msgs, struct pca9685 **dev, int n)
+{
+	int i;
+
+	if(pca9685_xfer(fleet->io, msgs, n) < 0)
+		return -1;
+	for(i = 0; i < n; i++)
+		pca9685_clean(dev[i], msgs[i].reg, msgs[i].len);
+	return 0;
+}
+
+// 보드별 dirty 버스트를 모아 FLEET_MSGS 개씩 backend 에 넘긴다.
+// 한 프레임(frame_us) 안에 끝나지 않을 보드는 다음 flush 로 미루고, 다음에는 그 보드부터 보낸다.
+// 반환값은 미뤄진 보드 수, 실패 시 -1
+int pca9685_fleet_flush(struct pca9685_fleet *fleet)
+{
+	struct pca9685_burst bursts[MAX_BURSTS];
+	struct pca9685 *pend_dev[FLEET_MSGS];
+	struct pca9685_msg msgs[FLEET_MSGS];
+	struct pca9685 *dev;
+	long used = 0, cost;
+	int k, i, j, n, nmsg = 0, deferred = 0;
+
+	for(k = 0; k < fleet->nboard; k++){
+		i = (fleet->next + k) % fleet->nboard;
+		dev = fleet->board[i];
+		n = pca9685_dirty_bursts(dev, bursts, MAX_BURSTS);
+		if(n == 0)
+			continue;
+
+		for(j = 0, cost = 0; j < n; j++)
+			cost += BURST_US(fleet, bursts[j].len);
+		if(used > 0 && used + cost > fleet->frame_us){
+			deferred = fleet->nboard - k;
+			break;
+		}
+		used += cost;
+
+		for(j = 0; j < n; j++){
+			if(nmsg == FLEET_MSGS){
+				if(fleet_send(fleet, msgs, pend_dev, nmsg) < 0)
+					return -1;
+				nmsg = 0;
+			}
+			// shadow 를 그대로 가리킨다. 보내기 전에는 다른 곳에서 바뀌지 않는다.
+			msgs[nmsg].addr = dev->addr;
+			msgs[nmsg].reg = bursts[j].addr;
+			msgs[nmsg].read = 0;
+			msgs[nmsg].len = bursts[j].len;
+			msgs[nmsg].buf = &dev->shadow[bursts[j].addr];
+			pend_dev[nmsg] = dev;
+			nmsg++;
+
+			dev->stats.transactions++;
+			dev->stats.tx_bytes += bursts[j].len + 1;
+		}
+		dev->stats.flushes++;
+		dev->stats.bursts += n;
+	}
+
+	if(nmsg > 0 && fleet_send(fleet, msgs, pend_dev, nmsg) < 0)
+		return -1;
+	fleet->next = deferred ? (fleet->next + fleet->nboard - deferred) % fleet->nboard : 0;
+	return deferred;
+}
+
+int pca9685_fleet_set_output_change(struct pca9685_fleet *fleet, int och)
+{
+	int i;
+
+	for(i = 0; i < fleet->nboard; i++)
+		if(pca9685_set_output_change(fleet->board[i], och) < 0)
+			return -1;
+	return 0;
+}
+
+// 모든 보드의 프레임을 전송 하나로 보낸다. flush 와 달리 frame_us 로 미루지 않는다.
+// rdwr backend 는 메시지 FLEET_MSGS 개마다 STOP 이 하나이므로, OCH_STOP 이면 그 안의 보드는
+// 같은 STOP 에서 함께 바뀐다. 긴 프레임의 보드를 앞에 두어 마지막 STOP 앞에 남는 전송을
+// 짧게 만든다. 그래서 보드 수가 FLEET_MSGS 를 넘거나 STOP 이 메시지마다 생기는 rw/smbus
+// backend 에서도 첫 보드와 마지막 보드가 바뀌는 시각의 차이가 가장 작다.
+// 반환값은 보낸 메시지 수, 실패 시 -1
+int pca9685_fleet_commit(struct pca9685_fleet *fleet)
+{
+	struct pca9685_msg msgs[FLEET_MAX * COMMIT_MSGS];
+	struct pca9685 *pend_dev[FLEET_MAX * COMMIT_MSGS];
+	struct pca9685_msg board_msgs[FLEET_MAX][COMMIT_MSGS];
+	int nmsg[FLEET_MAX], bytes[FLEET_MAX], order[FLEET_MAX];
+	struct pca9685 *dev;
+	int k, i, j, n = 0;
+
+	for(k = 0; k < fleet->nboard; k++){
+		nmsg[k] = pca9685_commit_msgs(fleet->board[k], board_msgs[k], COMMIT_MSGS);
+		if(nmsg[k] < 0)
+			return -1;
+		for(j = 0, bytes[k] = 0; j < nmsg[k]; j++)
+			bytes[k] += board_msgs[k][j].len + 2;
+		// 삽입 정렬: 보낼 바이트가 많은 보드부터
+		for(i = k; i > 0 && bytes[order[i - 1]] < bytes[k]; i--)
+			order[i] = order[i - 1];
+		order[i] = k;
+	}
+
+	for(k = 0; k < fleet->nboard; k++){
+		dev = fleet->board[order[k]];
+		for(j = 0; j < nmsg[order[k]]; j++){
+			msgs[n] = board_msgs[order[k]][j];
+			pend_dev[n] = dev;
+			n++;
+			dev->stats.transactions++;
+			dev->stats.tx_bytes += msgs[n - 1].len + 1;
+		}
+		if(nmsg[order[k]] > 0){
+			dev->stats.flushes++;
+			dev->stats.bursts += nmsg[order[k]];
+		}
+	}
+	if(n == 0)
+		return 0;
+	if(fleet_send(fleet, msgs, pend_dev, n) < 0)
+		return -1;
+	return n;
+}
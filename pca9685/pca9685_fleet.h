@@ -0,0 +1,43 @@
+#ifndef PCA9685_FLEET_H
+#define PCA9685_FLEET_H
+
+#include <stdint.h>
+
+#include "pca9685.h"
+
+#define FLEET_MAX 62		// 한 버스에 둘 수 있는 PCA9685 개수
+#define FLEET_GROUPS 3		// SUBADR1 ~ SUBADR3
+#define FLEET_ALLCALL -1	// broadcast 대상: ALLCALLADR
+#define ALLCALL_ADDR 0x70	// ALLCALLADR 기본값 0xE0 의 7bit 주소
+#define FRAME_US 20000		// 기본 프레임 주기 (50Hz 서보)
+
+// 같은 버스에 묶인 보드들. 공통 갱신은 ALLCALL/SUBADR 로 한 번에 보내고,
+// 보드별 변경분은 메시지 여러 개로 묶어 backend 에 한 번에 넘긴다(rdwr 이면 ioctl 한 번).
+struct pca9685_fleet {
+	struct pca9685 *io;	// 여러 주소로 보내는 버스 핸들. backend 와 통계는 여기에 있다
+	char bus[32];
+	struct pca9685 *board[FLEET_MAX];
+	int nboard;
+
+	int group_addr[FLEET_GROUPS];	// SUBADRn 에 쓴 7bit 주소 (0 = 미사용)
+	uint64_t group_mask[FLEET_GROUPS];	// 그룹에 속한 보드 비트
+
+	int bus_hz;		// flush 시간 추정용 SCL 속도
+	int frame_us;		// 한 프레임 안에 보드별 버스트에 쓸 수 있는 시간
+	int next;		// 지난 flush 에서 밀린 보드부터 다시 시작
+};
+
+struct pca9685_fleet *pca9685_fleet_open(const char *bus);
+void pca9685_fleet_close(struct pca9685_fleet *fleet);
+int pca9685_fleet_add(struct pca9685_fleet *fleet, int addr);
+
+int pca9685_fleet_set_group(struct pca9685_fleet *fleet, int group, int addr, uint64_t mask);
+int pca9685_fleet_broadcast(struct pca9685_fleet *fleet, int group, int reg, const uint8_t *data, int len);
+int pca9685_fleet_set_frequency(struct pca9685_fleet *fleet, int hz, uint32_t *actual_millihz);
+int pca9685_fleet_all_off(struct pca9685_fleet *fleet);
+int pca9685_fleet_group_led(struct pca9685_fleet *fleet, int group, int ch, int on, int off);
+int pca9685_fleet_flush(struct pca9685_fleet *fleet);
+int pca9685_fleet_set_output_change(struct pca9685_fleet *fleet, int och);
+int pca9685_fleet_commit(struct pca9685_fleet *fleet);
+
+#endif
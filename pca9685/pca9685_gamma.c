@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "pca9685_map.h"
+
+// 컴파일 대상에 맞는 SIMD 를 쓴다. -DPCA9685_NO_SIMD 로 스칼라 경로를 강제할 수 있다.
+#if defined(__SSE2__) && !defined(PCA9685_NO_SIMD)
+#include <emmintrin.h>
+#define GAMMA_SSE2
+#elif defined(__ARM_NEON) && !defined(PCA9685_NO_SIMD)
+#include <arm_neon.h>
+#define GAMMA_NEON
+#endif
+
+#define GAMMA_TOP (GAMMA_LEVELS - 1)
+
+// 16bit 밝기 = 테이블 index(상위 8bit) + 보간 비율(하위 8bit)
+static uint16_t gamma16(uint16_t level)
+{
+	int idx = level >> 8, frac = level & 0xff;
+	int lo = pca9685_gamma8[idx];
+	int hi = pca9685_gamma8[idx < GAMMA_TOP ? idx + 1 : GAMMA_TOP];
+
+	return lo + (((hi - lo) * (frac << 8)) >> 16);
+}
+
+void pca9685_gamma8_batch(const uint8_t *level, uint16_t *ticks, int n)
+{
+	int i;
+
+	// 순수한 표 조회라 SSE2/NEON 에 gather 가 없어 스칼라가 가장 빠르다.
+	for(i = 0; i < n; i++)
+		ticks[i] = pca9685_gamma8[level[i]];
+}
+
+// 8개씩 표의 양 끝값을 모은 뒤 보간은 벡터로 한다.
+// (hi - lo) * frac 은 16bit 를 넘으므로 frac 을 8bit 올려 곱의 상위 16bit 만 취한다.
+void pca9685_gamma16_batch(const uint16_t *level, uint16_t *ticks, int n)
+{
+	int i = 0;
+#if defined(GAMMA_SSE2) || defined(GAMMA_NEON)
+	uint16_t lo[8], hi[8];
+	int k, idx;
+
+	for(; i + 8 <= n; i += 8){
+		for(k = 0; k < 8; k++){
+			idx = level[i + k] >> 8;
+			lo[k] = pca9685_gamma8[idx];
+			hi[k] = pca9685_gamma8[idx < GAMMA_TOP ? idx + 1 : GAMMA_TOP];
+		}
+#ifdef GAMMA_SSE2
+		__m128i v = _mm_loadu_si128((const __m128i *)&level[i]);
+		__m128i a = _mm_loadu_si128((const __m128i *)lo);
+		__m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)hi), a);
+		__m128i r = _mm_add_epi16(a, _mm_mulhi_epu16(d, _mm_slli_epi16(v, 8)));
+		_mm_storeu_si128((__m128i *)&ticks[i], r);
+#else
+		uint16x8_t f = vshlq_n_u16(vld1q_u16(&level[i]), 8);
+		uint16x8_t a = vld1q_u16(lo);
+		uint16x8_t d = vsubq_u16(vld1q_u16(hi), a);
+		uint32x4_t ml = vmull_u16(vget_low_u16(d), vget_low_u16(f));
+		uint32x4_t mh = vmull_u16(vget_high_u16(d), vget_high_u16(f));
+		vst1q_u16(&ticks[i], vaddq_u16(a, vcombine_u16(vshrn_n_u32(ml, 16), vshrn_n_u32(mh, 16))));
+#endif
+	}
+#endif
+	for(; i < n; i++)
+		ticks[i] = gamma16(level[i]);
+}
+
+// 16채널의 duty(0 ~ DUTY_FULL)를 LED0_ON_L ~ LED15_OFF_H 64바이트로 만든다.
+// 출력은 pca9685_set_duty() 와 같다. 0 은 OFF_H 의 full off, DUTY_FULL 은 ON_H 의 full on
+void pca9685_led_pack_all(const uint16_t *duty, int stagger, uint8_t *regs)
+{
+	int ch;
+#if defined(GAMMA_SSE2)
+	const __m128i full = _mm_set1_epi16(DUTY_FULL);
+	const __m128i mask = _mm_set1_epi16(DUTY_FULL - 1);
+	const __m128i bit = _mm_set1_epi16(LED_FULL << 8);
+	__m128i on, t, off, ON, OFF;
+
+	for(ch = 0; ch < LED_NUM; ch += 8){
+		on = stagger ? _mm_setr_epi16(ch * PHASE_STEP, (ch + 1) * PHASE_STEP, (ch + 2) * PHASE_STEP,
+				(ch + 3) * PHASE_STEP, (ch + 4) * PHASE_STEP, (ch + 5) * PHASE_STEP,
+				(ch + 6) * PHASE_STEP, (ch + 7) * PHASE_STEP) : _mm_setzero_si128();
+		t = _mm_loadu_si128((const __m128i *)&duty[ch]);
+		t = _mm_sub_epi16(t, _mm_subs_epu16(t, full));		// min(t, DUTY_FULL)
+		off = _mm_and_si128(_mm_add_epi16(on, t), mask);
+		OFF = _mm_or_si128(off, _mm_and_si128(_mm_cmpeq_epi16(t, _mm_setzero_si128()), bit));
+		ON = _mm_or_si128(on, _mm_and_si128(_mm_cmpeq_epi16(t, full), bit));
+		// (ON, OFF) 를 채널마다 번갈아 놓으면 그대로 레지스터 순서가 된다(little endian).
+		_mm_storeu_si128((__m128i *)&regs[ch * 4], _mm_unpacklo_epi16(ON, OFF));
+		_mm_storeu_si128((__m128i *)&regs[ch * 4 + 16], _mm_unpackhi_epi16(ON, OFF));
+	}
+#elif defined(GAMMA_NEON)
+	static const uint16_t phase[LED_NUM] = {
+		0 * PHASE_STEP, 1 * PHASE_STEP, 2 * PHASE_STEP, 3 * PHASE_STEP,
+		4 * PHASE_STEP, 5 * PHASE_STEP, 6 * PHASE_STEP, 7 * PHASE_STEP,
+		8 * PHASE_STEP, 9 * PHASE_STEP, 10 * PHASE_STEP, 11 * PHASE_STEP,
+		12 * PHASE_STEP, 13 * PHASE_STEP, 14 * PHASE_STEP, 15 * PHASE_STEP,
+	};
+	const uint16x8_t full = vdupq_n_u16(DUTY_FULL);
+	const uint16x8_t bit = vdupq_n_u16(LED_FULL << 8);
+	uint16x8_t on, t, off, ON, OFF;
+	uint16x8x2_t z;
+
+	for(ch = 0; ch < LED_NUM; ch += 8){
+		on = stagger ? vld1q_u16(&phase[ch]) : vdupq_n_u16(0);
+		t = vminq_u16(vld1q_u16(&duty[ch]), full);
+		off = vandq_u16(vaddq_u16(on, t), vdupq_n_u16(DUTY_FULL - 1));
+		OFF = vorrq_u16(off, vandq_u16(vceqq_u16(t, vdupq_n_u16(0)), bit));
+		ON = vorrq_u16(on, vandq_u16(vceqq_u16(t, full), bit));
+		z = vzipq_u16(ON, OFF);
+		vst1q_u16((uint16_t *)&regs[ch * 4], z.val[0]);
+		vst1q_u16((uint16_t *)&regs[ch * 4 + 16], z.val[1]);
+	}
+#else
+	int on, off, t;
+	uint8_t *led;
+
+	for(ch = 0; ch < LED_NUM; ch++){
+		led = &regs[ch * 4];
+		on = stagger ? ch * PHASE_STEP : 0;
+		t = duty[ch] > DUTY_FULL ? DUTY_FULL : duty[ch];
+		off = (on + t) & (DUTY_FULL - 1);
+		led[0] = on & 0xff;
+		led[1] = (on >> 8) | (t == DUTY_FULL ? LED_FULL : 0);
+		led[2] = off & 0xff;
+		led[3] = (off >> 8) | (t == 0 ? LED_FULL : 0);
+	}
+#endif
+}
+
+// 16채널 밝기를 변환해 LEDn 블록 전체를 shadow 에 한 번에 넣는다.
+// 바뀐 바이트만 dirty 가 되므로 pca9685_flush() 는 필요한 구간만 버스트로 보낸다.
+void pca9685_set_brightness8(struct pca9685 *dev, const uint8_t *level)
+{
+	uint16_t ticks[LED_NUM];
+	uint8_t regs[LED_NUM * 4];
+
+	pca9685_gamma8_batch(level, ticks, LED_NUM);
+	pca9685_led_pack_all(ticks, dev->stagger, regs);
+	pca9685_set(dev, LED0_ON_L, regs, sizeof(regs));
+}
+
+void pca9685_set_brightness16(struct pca9685 *dev, const uint16_t *level)
+{
+	uint16_t ticks[LED_NUM];
+	uint8_t regs[LED_NUM * 4];
+
+	pca9685_gamma16_batch(level, ticks, LED_NUM);
+	pca9685_led_pack_all(ticks, dev->stagger, regs);
+	pca9685_set(dev, LED0_ON_L, regs, sizeof(regs));
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "pca9685_map.h"
+
+#define TICK_MAX 4095
+
+// round(4095 * (i / 255)^2.2), 255 는 DUTY_FULL(항상 켜짐)
+const uint16_t pca9685_gamma8[GAMMA_LEVELS] = {
+	   0,    0,    0,    0,    0,    1,    1,    2,    2,    3,    3,    4,
+	   5,    6,    7,    8,    9,   11,   12,   14,   15,   17,   19,   21,
+	  23,   25,   27,   29,   32,   34,   37,   40,   43,   46,   49,   52,
+	  55,   59,   62,   66,   70,   73,   77,   82,   86,   90,   95,   99,
+	 104,  109,  114,  119,  124,  129,  135,  140,  146,  152,  158,  164,
+	 170,  176,  182,  189,  196,  202,  209,  216,  224,  231,  238,  246,
+	 254,  261,  269,  277,  286,  294,  302,  311,  320,  328,  337,  347,
+	 356,  365,  375,  384,  394,  404,  414,  424,  435,  445,  456,  467,
+	 477,  488,  500,  511,  522,  534,  545,  557,  569,  581,  594,  606,
+	 619,  631,  644,  657,  670,  683,  697,  710,  724,  738,  752,  766,
+	 780,  794,  809,  823,  838,  853,  868,  884,  899,  914,  930,  946,
+	 962,  978,  994, 1011, 1027, 1044, 1061, 1078, 1095, 1112, 1130, 1147,
+	1165, 1183, 1201, 1219, 1237, 1256, 1274, 1293, 1312, 1331, 1350, 1370,
+	1389, 1409, 1429, 1449, 1469, 1489, 1509, 1530, 1551, 1572, 1593, 1614,
+	1635, 1657, 1678, 1700, 1722, 1744, 1766, 1789, 1811, 1834, 1857, 1880,
+	1903, 1926, 1950, 1974, 1997, 2021, 2045, 2070, 2094, 2119, 2143, 2168,
+	2193, 2219, 2244, 2270, 2295, 2321, 2347, 2373, 2400, 2426, 2453, 2479,
+	2506, 2534, 2561, 2588, 2616, 2644, 2671, 2700, 2728, 2756, 2785, 2813,
+	2842, 2871, 2900, 2930, 2959, 2989, 3019, 3049, 3079, 3109, 3140, 3170,
+	3201, 3232, 3263, 3295, 3326, 3358, 3390, 3421, 3454, 3486, 3518, 3551,
+	3584, 3617, 3650, 3683, 3716, 3750, 3784, 3818, 3852, 3886, 3920, 3955,
+	3990, 4025, 4060, DUTY_FULL,
+};
+
+static uint16_t us_to_ticks(uint32_t ticks_per_us_q16, int us)
+{
+	uint32_t ticks;
+
+	if(us <= 0)
+		return 0;
+	ticks = ((uint64_t)us * ticks_per_us_q16 + 0x8000) >> 16;
+	return ticks > TICK_MAX ? TICK_MAX : ticks;
+}
+
+void pca9685_map_build(struct pca9685_map *map, int prescale, int us_min, int us_max)
+{
+	int deg;
+
+	map->prescale = prescale;
+	map->us_min = us_min;
+	map->us_max = us_max;
+	// tick 하나는 (prescale + 1) / CLOCK_FREQ 초
+	map->ticks_per_us_q16 = ((uint64_t)CLOCK_FREQ << 16) / ((uint64_t)(prescale + 1) * 1000000);
+	for(deg = 0; deg <= ANGLE_MAX; deg++)
+		map->angle_ticks[deg] = us_to_ticks(map->ticks_per_us_q16,
+				us_min + (us_max - us_min) * deg / ANGLE_MAX);
+}
+
+// 칩의 prescale 이 바뀌었으면 테이블을 다시 만든다. 다시 만들었으면 1
+int pca9685_map_update(struct pca9685_map *map, struct pca9685 *dev)
+{
+	int us_min = map->us_min, us_max = map->us_max;
+
+	if(map->prescale == dev->shadow[PRE_SCALE])
+		return 0;
+	if(us_min == 0 && us_max == 0){
+		us_min = SERVO_US_MIN;
+		us_max = SERVO_US_MAX;
+	}
+	pca9685_map_build(map, dev->shadow[PRE_SCALE], us_min, us_max);
+	return 1;
+}
+
+uint16_t pca9685_map_us(const struct pca9685_map *map, int us)
+{
+	return us_to_ticks(map->ticks_per_us_q16, us);
+}
+
+// decideg: 0.1도 단위 (0 ~ 1800)
+uint16_t pca9685_map_angle(const struct pca9685_map *map, int decideg)
+{
+	int deg, frac, t0, t1;
+
+	if(decideg <= 0)
+		return map->angle_ticks[0];
+	if(decideg >= ANGLE_MAX * 10)
+		return map->angle_ticks[ANGLE_MAX];
+	deg = decideg / 10;
+	frac = decideg % 10;
+	t0 = map->angle_ticks[deg];
+	t1 = map->angle_ticks[deg + 1];
+	return t0 + (t1 - t0) * frac / 10;
+}
+
+void pca9685_map_us_all(const struct pca9685_map *map, const uint16_t *us, uint16_t *ticks)
+{
+	int ch;
+
+	for(ch = 0; ch < LED_NUM; ch++)
+		ticks[ch] = us_to_ticks(map->ticks_per_us_q16, us[ch]);
+}
+
+void pca9685_map_angle_all(const struct pca9685_map *map, const uint16_t *decideg, uint16_t *ticks)
+{
+	int ch;
+
+	for(ch = 0; ch < LED_NUM; ch++)
+		ticks[ch] = pca9685_map_angle(map, decideg[ch]);
+}
+
+void pca9685_map_gamma_all(const uint8_t *level, uint16_t *ticks)
+{
+	pca9685_gamma8_batch(level, ticks, LED_NUM);
+}
+
+void pca9685_set_us_all(struct pca9685 *dev, struct pca9685_map *map, const uint16_t *us)
+{
+	uint16_t ticks[LED_NUM];
+
+	pca9685_map_update(map, dev);
+	pca9685_map_us_all(map, us, ticks);
+	pca9685_set_duty_all(dev, ticks);
+}
+
+void pca9685_set_angle_all(struct pca9685 *dev, struct pca9685_map *map, const uint16_t *decideg)
+{
+	uint16_t ticks[LED_NUM];
+
+	pca9685_map_update(map, dev);
+	pca9685_map_angle_all(map, decideg, ticks);
+	pca9685_set_duty_all(dev, ticks);
+}
+
+void pca9685_set_gamma_all(struct pca9685 *dev, const uint8_t *level)
+{
+	uint16_t ticks[LED_NUM];
+
+	pca9685_map_gamma_all(level, ticks);
+	pca9685_set_duty_all(dev, ticks);
+}
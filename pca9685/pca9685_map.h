@@ -0,0 +1,48 @@
+#ifndef PCA9685_MAP_H
+#define PCA9685_MAP_H
+
+#include <stdint.h>
+
+#include "pca9685.h"
+
+#define SERVO_US_MIN 500	// 0도 펄스 폭
+#define SERVO_US_MAX 2500	// 180도 펄스 폭
+#define ANGLE_MAX 180
+#define GAMMA_LEVELS 256
+
+// prescale 하나에 대한 변환 테이블. 주파수가 바뀌면(prescale 이 달라지면) 다시 만든다.
+// 펄스 폭은 Q16 고정소수점 곱셈, 각도는 1도 단위 테이블 + 0.1도 보간으로 변환한다.
+struct pca9685_map {
+	int prescale;
+	uint32_t ticks_per_us_q16;
+	int us_min, us_max;
+	uint16_t angle_ticks[ANGLE_MAX + 1];
+};
+
+// 8bit 밝기 -> 12bit tick (gamma 2.2), 컴파일 시 생성된 테이블
+extern const uint16_t pca9685_gamma8[GAMMA_LEVELS];
+
+void pca9685_map_build(struct pca9685_map *map, int prescale, int us_min, int us_max);
+int pca9685_map_update(struct pca9685_map *map, struct pca9685 *dev);
+
+uint16_t pca9685_map_us(const struct pca9685_map *map, int us);
+uint16_t pca9685_map_angle(const struct pca9685_map *map, int decideg);
+
+// 16채널을 한 번에 변환한다.
+void pca9685_map_us_all(const struct pca9685_map *map, const uint16_t *us, uint16_t *ticks);
+void pca9685_map_angle_all(const struct pca9685_map *map, const uint16_t *decideg, uint16_t *ticks);
+void pca9685_map_gamma_all(const uint8_t *level, uint16_t *ticks);
+
+// 여러 채널(보드 여러 장 분량도 가능)을 한 번에 변환한다. 16bit 는 표 사이를 보간한다.
+void pca9685_gamma8_batch(const uint8_t *level, uint16_t *ticks, int n);
+void pca9685_gamma16_batch(const uint16_t *level, uint16_t *ticks, int n);
+void pca9685_led_pack_all(const uint16_t *duty, int stagger, uint8_t *regs);
+
+// 변환 결과를 바로 shadow 에 넣는다. 버스 전송은 pca9685_flush() 에서 한다.
+void pca9685_set_us_all(struct pca9685 *dev, struct pca9685_map *map, const uint16_t *us);
+void pca9685_set_angle_all(struct pca9685 *dev, struct pca9685_map *map, const uint16_t *decideg);
+void pca9685_set_gamma_all(struct pca9685 *dev, const uint8_t *level);
+void pca9685_set_brightness8(struct pca9685 *dev, const uint8_t *level);
+void pca9685_set_brightness16(struct pca9685 *dev, const uint16_t *level);
+
+#endif
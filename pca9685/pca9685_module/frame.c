@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "pca9685_ioctl.h"
+
+// 사용법: ./frame ch:duty [ch:duty ...]
+// 인자로 준 채널을 프레임 하나로 묶어 ioctl 한 번에 보낸다.
+int main(int argc, char** argv)
+{
+    struct pca9685_frame frame;
+    struct pca9685_kstats stats;
+    int fd, i, ch, duty;
+
+    memset(&frame, 0, sizeof(frame));
+    for (i = 1; i < argc; i++) {
+        if (sscanf(argv[i], "%d:%d", &ch, &duty) != 2 || ch < 0 || ch >= PCA9685_CHANNELS) {
+            printf("bad channel : %s\n", argv[i]);
+            return -1;
+        }
+        frame.mask |= 1 << ch;
+        frame.duty[ch] = duty;
+    }
+
+    fd = open("/dev/pca9685", O_RDWR);
+    if (fd < 0) {
+        printf("can not open /dev/pca9685\n");
+        return -1;
+    }
+    if (ioctl(fd, PCA9685_IOC_FRAME, &frame) < 0)
+        printf("Failed to send frame\n");
+    if (ioctl(fd, PCA9685_IOC_STATS, &stats) == 0)
+        printf("frames %llu, bursts %llu, bytes %llu, errors %llu\n",
+               (unsigned long long)stats.frames, (unsigned long long)stats.bursts,
+               (unsigned long long)stats.bytes, (unsigned long long)stats.errors);
+    close(fd);
+    return 0;
+}
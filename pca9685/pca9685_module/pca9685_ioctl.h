@@ -0,0 +1,35 @@
+#ifndef PCA9685_IOCTL_H
+#define PCA9685_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+//===============================================
+// pca9685_module 과 유저 프로그램이 함께 쓰는 ioctl 정의
+// /dev/pca9685N (major 201, minor = probe 순서)
+//===============================================
+
+#define PCA9685_MAJOR       201
+#define PCA9685_CHANNELS    16
+#define PCA9685_DUTY_FULL   4096
+
+// 한 프레임: mask 에 표시된 채널의 duty(0 ~ 4096)를 한 번에 바꾼다.
+// 드라이버는 바뀐 레지스터 구간을 auto-increment 버스트 하나로 보낸다.
+struct pca9685_frame {
+    __u16 mask;                         // bit n = 채널 n
+    __u16 duty[PCA9685_CHANNELS];
+};
+
+struct pca9685_kstats {
+    __u64 frames;
+    __u64 bursts;                       // 실제로 버스에 나간 버스트
+    __u64 bytes;                        // 레지스터 포인터 포함
+    __u64 errors;
+};
+
+#define PCA9685_IOC_MAGIC   'p'
+#define PCA9685_IOC_FRAME   _IOW(PCA9685_IOC_MAGIC, 1, struct pca9685_frame)
+#define PCA9685_IOC_FREQ    _IOW(PCA9685_IOC_MAGIC, 2, __u32)      // Hz
+#define PCA9685_IOC_STATS   _IOR(PCA9685_IOC_MAGIC, 3, struct pca9685_kstats)
+
+#endif
@@ -0,0 +1,571 @@
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/module.h>
+#include <linux/i2c.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/kref.h>
+#include <linux/pwm.h>
+#include <linux/math64.h>
+#include <linux/version.h>
+#include <linux/uaccess.h>
+
+#include "pca9685_ioctl.h"
+
+#define PCA9685_DEVICE      "pca9685"
+#define PCA9685_MINORS      8                   // 드라이버 하나가 붙일 수 있는 칩 수
+
+//===============================================
+// PCA9685 레지스터 (pca9685/pca9685.h 와 같은 값)
+//===============================================
+#define MODE1               0x00
+#define MODE2               0x01
+#define MODE1_RESTART       0x80
+#define MODE1_AI            0x20
+#define MODE1_SLEEP         0x10
+#define MODE2_OUTDRV        0x04
+#define LED0_ON_L           0x06
+#define LED_REG(n)          (LED0_ON_L + 4 * (n))
+#define LED_FULL            0x10
+#define REG_FILE_SIZE       0x46                // MODE1 ~ LED15_OFF_H
+#define PRE_SCALE           0xFE
+#define CLOCK_FREQ          25000000
+#define PRESCALE_MIN        3
+#define PRESCALE_MAX        255
+#define PHASE_STEP          256
+
+static int pwm_freq = 100;
+module_param(pwm_freq, int, 0444);
+MODULE_PARM_DESC(pwm_freq, "PWM frequency (Hz) set at probe");
+
+static bool stagger = true;
+module_param(stagger, bool, 0444);
+MODULE_PARM_DESC(stagger, "Shift each channel's ON phase by 256 ticks");
+
+static bool use_pwm = true;
+module_param(use_pwm, bool, 0444);
+MODULE_PARM_DESC(use_pwm, "Register a pwm_chip for other kernel consumers");
+
+struct pca9685_dev {
+    struct i2c_client *client;
+    struct mutex lock;                  // ioctl 과 pwm 요청을 직렬화
+    struct cdev *cdev;
+    struct kref ref;                    // probe 하나 + 열린 파일마다 하나
+    bool removed;                       // remove 뒤에는 열린 파일의 ioctl 도 -ENODEV (lock 으로 보호)
+    int minor;
+    u8 regs[REG_FILE_SIZE];             // 칩 레지스터의 사본
+    u8 prescale;
+    struct pca9685_kstats stats;
+#if IS_ENABLED(CONFIG_PWM)
+    struct pwm_chip *pwm;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 9, 0)
+    struct pwm_chip pwm_chip;
+#endif
+#endif
+};
+
+static struct pca9685_dev *devs[PCA9685_MINORS];
+static DEFINE_MUTEX(devs_lock);
+
+//===============================================
+// 버스 전송
+// I2C 어댑터는 i2c_master_send 한 번으로 버스트 전체를 보내고,
+// SMBus 만 되는 어댑터(i2c-stub 등)는 I2C block 32바이트씩 나누어 보낸다.
+//===============================================
+static int burst_write(struct pca9685_dev *pd, u8 reg, const u8 *data, int len)
+{
+    struct i2c_client *client = pd->client;
+    u8 buf[1 + REG_FILE_SIZE];
+    int ret, off, n;
+
+    if (i2c_check_functionality(client->adapter, I2C_FUNC_I2C)) {
+        buf[0] = reg;
+        memcpy(buf + 1, data, len);
+        ret = i2c_master_send(client, buf, len + 1);
+        if (ret >= 0 && ret != len + 1)
+            ret = -EIO;
+        pd->stats.bursts++;
+    } else {
+        for (off = 0, ret = 0; off < len && ret >= 0; off += n) {
+            n = min(len - off, I2C_SMBUS_BLOCK_MAX);
+            ret = i2c_smbus_write_i2c_block_data(client, reg + off, n, data + off);
+            pd->stats.bursts++;
+        }
+    }
+    if (ret < 0) {
+        pd->stats.errors++;
+        return ret;
+    }
+    pd->stats.bytes += len + 1;
+    return 0;
+}
+
+static int burst_read(struct pca9685_dev *pd, u8 reg, u8 *data, int len)
+{
+    int ret, off, n;
+
+    for (off = 0; off < len; off += n) {
+        n = min(len - off, I2C_SMBUS_BLOCK_MAX);
+        ret = i2c_smbus_read_i2c_block_data(pd->client, reg + off, n, data + off);
+        if (ret != n)
+            return ret < 0 ? ret : -EIO;
+    }
+    return 0;
+}
+
+static void led_pack(u8 *led, int on, int off)
+{
+    led[0] = on & 0xff;
+    led[1] = (on >> 8) & 0x1f;
+    led[2] = off & 0xff;
+    led[3] = (off >> 8) & 0x1f;
+}
+
+//===============================================
+// 프레임 적용
+// mask 채널의 duty 를 사본에 반영하고, 바뀐 바이트의 처음부터 끝까지를
+// auto-increment 버스트 하나로 보낸다. 채널 수와 관계없이 전송은 한 번이다.
+// duty 변환은 유저 라이브러리의 pca9685_set_duty() 와 같다.
+//===============================================
+static int frame_apply(struct pca9685_dev *pd, u16 mask, const u16 *duty)
+{
+    u8 next[REG_FILE_SIZE], *led;
+    int ch, on, i, first = -1, last = -1, ret;
+
+    memcpy(next, pd->regs, sizeof(next));
+    for (ch = 0; ch < PCA9685_CHANNELS; ch++) {
+        if (!(mask & (1 << ch)))
+            continue;
+        led = &next[LED_REG(ch)];
+        if (duty[ch] == 0) {
+            led[3] |= LED_FULL;
+        } else if (duty[ch] >= PCA9685_DUTY_FULL) {
+            led[1] |= LED_FULL;
+            led[3] &= ~LED_FULL;        // full off 가 full on 보다 우선한다
+        } else {
+            on = stagger ? ch * PHASE_STEP : 0;
+            led_pack(led, on, (on + duty[ch]) & (PCA9685_DUTY_FULL - 1));
+        }
+    }
+
+    for (i = LED0_ON_L; i < REG_FILE_SIZE; i++) {
+        if (next[i] == pd->regs[i])
+            continue;
+        if (first < 0)
+            first = i;
+        last = i;
+    }
+    pd->stats.frames++;
+    if (first < 0)
+        return 0;
+
+    ret = burst_write(pd, first, next + first, last - first + 1);
+    if (ret < 0)
+        return ret;
+    memcpy(pd->regs + first, next + first, last - first + 1);
+    return 0;
+}
+
+//===============================================
+// sleep -> prescale -> wake -> 500us -> RESTART
+//===============================================
+static int set_frequency(struct pca9685_dev *pd, int hz)
+{
+    struct i2c_client *client = pd->client;
+    int prescale, mode1, ret;
+
+    if (hz <= 0)
+        return -EINVAL;
+    prescale = DIV_ROUND_CLOSEST(CLOCK_FREQ, 4096 * hz) - 1;
+    prescale = clamp(prescale, PRESCALE_MIN, PRESCALE_MAX);
+    if (prescale == pd->prescale)
+        return 0;
+
+    mode1 = pd->regs[MODE1] & ~(MODE1_RESTART | MODE1_SLEEP);
+    ret = i2c_smbus_write_byte_data(client, MODE1, mode1 | MODE1_SLEEP);
+    if (!ret)
+        ret = i2c_smbus_write_byte_data(client, PRE_SCALE, prescale);
+    if (!ret)
+        ret = i2c_smbus_write_byte_data(client, MODE1, mode1);
+    if (ret) {
+        pd->stats.errors++;
+        return ret;
+    }
+    usleep_range(500, 1000);
+    ret = i2c_smbus_write_byte_data(client, MODE1, mode1 | MODE1_RESTART);
+    if (ret) {
+        pd->stats.errors++;
+        return ret;
+    }
+    pd->regs[MODE1] = mode1;
+    pd->prescale = prescale;
+    return 0;
+}
+
+//===============================================
+// 칩을 깨우고(AI 켬) 현재 레지스터를 읽어 사본을 맞춘다.
+// 이미 돌던 채널 출력은 건드리지 않는다.
+//===============================================
+static int chip_init(struct pca9685_dev *pd)
+{
+    struct i2c_client *client = pd->client;
+    int mode1, ret;
+
+    mode1 = i2c_smbus_read_byte_data(client, MODE1);
+    if (mode1 < 0)
+        return mode1;
+    // AI 가 켜져야 블록 읽기가 레지스터를 따라 올라간다.
+    ret = i2c_smbus_write_byte_data(client, MODE1, (mode1 & ~MODE1_RESTART) | MODE1_AI);
+    if (ret)
+        return ret;
+    ret = burst_read(pd, MODE1, pd->regs, REG_FILE_SIZE);
+    if (ret)
+        return ret;
+    ret = i2c_smbus_read_byte_data(client, PRE_SCALE);
+    if (ret < 0)
+        return ret;
+    pd->prescale = ret;
+
+    ret = i2c_smbus_write_byte_data(client, MODE2, MODE2_OUTDRV);
+    if (ret)
+        return ret;
+    pd->regs[MODE2] = MODE2_OUTDRV;
+
+    // prescale 이 이미 같으면 set_frequency 는 아무것도 하지 않으므로 SLEEP 은 여기서 푼다.
+    if (pd->regs[MODE1] & MODE1_SLEEP) {
+        mode1 = pd->regs[MODE1] & ~(MODE1_SLEEP | MODE1_RESTART);
+        ret = i2c_smbus_write_byte_data(client, MODE1, mode1);
+        if (ret)
+            return ret;
+        usleep_range(500, 1000);
+        if (pd->regs[MODE1] & MODE1_RESTART) {
+            ret = i2c_smbus_write_byte_data(client, MODE1, mode1 | MODE1_RESTART);
+            if (ret)
+                return ret;
+        }
+        pd->regs[MODE1] = mode1;
+    }
+    return set_frequency(pd, pwm_freq);
+}
+
+//===============================================
+// pwm_chip: 다른 커널 드라이버(pwm-leds, pwm-backlight 등)가 채널을 쓰게 한다.
+// 주기는 칩 전체가 한 prescale 을 공유하므로 period 를 바꾸면 모든 채널의 주파수가 바뀐다.
+//===============================================
+#if IS_ENABLED(CONFIG_PWM)
+static struct pca9685_dev *to_pca9685(struct pwm_chip *chip)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 9, 0)
+    return container_of(chip, struct pca9685_dev, pwm_chip);
+#else
+    return pwmchip_get_drvdata(chip);
+#endif
+}
+
+static int pca9685_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 2, 0)
+                             struct pwm_state *state)
+#else
+                             const struct pwm_state *state)
+#endif
+{
+    struct pca9685_dev *pd = to_pca9685(chip);
+    u16 duty[PCA9685_CHANNELS] = {0};
+    int ret = 0;
+
+    if (state->polarity != PWM_POLARITY_NORMAL)
+        return -EINVAL;
+
+    mutex_lock(&pd->lock);
+    if (state->enabled && state->period) {
+        ret = set_frequency(pd, div64_u64(NSEC_PER_SEC, state->period));
+        duty[pwm->hwpwm] = min_t(u64, div64_u64((u64)state->duty_cycle * PCA9685_DUTY_FULL, state->period),
+                                 PCA9685_DUTY_FULL);
+    }
+    if (!ret)
+        ret = frame_apply(pd, 1 << pwm->hwpwm, duty);
+    mutex_unlock(&pd->lock);
+    return ret;
+}
+
+static const struct pwm_ops pca9685_pwm_ops = {
+    .apply = pca9685_pwm_apply,
+};
+
+static int pwm_register(struct pca9685_dev *pd)
+{
+    struct device *dev = &pd->client->dev;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 9, 0)
+    pd->pwm = &pd->pwm_chip;
+    pd->pwm->dev = dev;
+    pd->pwm->npwm = PCA9685_CHANNELS;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
+    pd->pwm->base = -1;
+#endif
+#else
+    pd->pwm = devm_pwmchip_alloc(dev, PCA9685_CHANNELS, 0);
+    if (IS_ERR(pd->pwm))
+        return PTR_ERR(pd->pwm);
+    pwmchip_set_drvdata(pd->pwm, pd);
+#endif
+    pd->pwm->ops = &pca9685_pwm_ops;
+    return pwmchip_add(pd->pwm);
+}
+
+static void pwm_unregister(struct pca9685_dev *pd)
+{
+    if (pd->pwm)
+        pwmchip_remove(pd->pwm);
+}
+#else
+static int pwm_register(struct pca9685_dev *pd) { return 0; }
+static void pwm_unregister(struct pca9685_dev *pd) { }
+#endif
+
+//===============================================
+// char device
+// 열린 파일은 pd 의 참조를 하나씩 가진다. 칩이 unbind 되어도 마지막 close 까지 pd 는 남고
+// 그 사이 ioctl 은 -ENODEV 를 돌려준다.
+//===============================================
+static void pca9685_dev_release(struct kref *ref)
+{
+    kfree(container_of(ref, struct pca9685_dev, ref));
+}
+
+static int pca9685_open(struct inode *inod, struct file *fil)
+{
+    struct pca9685_dev *pd;
+
+    mutex_lock(&devs_lock);
+    pd = iminor(inod) < PCA9685_MINORS ? devs[iminor(inod)] : NULL;
+    if (pd)
+        kref_get(&pd->ref);
+    mutex_unlock(&devs_lock);
+    if (!pd)
+        return -ENODEV;
+    fil->private_data = pd;
+    return 0;
+}
+
+static int pca9685_close(struct inode *inod, struct file *fil)
+{
+    struct pca9685_dev *pd = fil->private_data;
+
+    kref_put(&pd->ref, pca9685_dev_release);
+    return 0;
+}
+
+static long pca9685_ioctl(struct file *fil, unsigned int cmd, unsigned long arg)
+{
+    struct pca9685_dev *pd = fil->private_data;
+    struct pca9685_frame frame;
+    struct pca9685_kstats stats;
+    u32 hz;
+    long ret;
+
+    switch (cmd) {
+    case PCA9685_IOC_FRAME:
+        if (copy_from_user(&frame, (void __user *)arg, sizeof(frame)))
+            return -EFAULT;
+        break;
+    case PCA9685_IOC_FREQ:
+        if (copy_from_user(&hz, (void __user *)arg, sizeof(hz)))
+            return -EFAULT;
+        break;
+    case PCA9685_IOC_STATS:
+        break;
+    default:
+        return -ENOTTY;
+    }
+
+    mutex_lock(&pd->lock);
+    if (pd->removed)
+        ret = -ENODEV;
+    else if (cmd == PCA9685_IOC_FRAME)
+        ret = frame_apply(pd, frame.mask, frame.duty);
+    else if (cmd == PCA9685_IOC_FREQ)
+        ret = set_frequency(pd, hz);
+    else {
+        stats = pd->stats;
+        ret = 0;
+    }
+    mutex_unlock(&pd->lock);
+
+    if (!ret && cmd == PCA9685_IOC_STATS && copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+        return -EFAULT;
+    return ret;
+}
+
+static struct file_operations pca9685_fops = {
+    .owner          = THIS_MODULE,
+    .open           = pca9685_open,
+    .release        = pca9685_close,
+    .unlocked_ioctl = pca9685_ioctl,
+};
+
+//===============================================
+// i2c_driver
+//===============================================
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 3, 0)
+static int pca9685_probe(struct i2c_client *client, const struct i2c_device_id *id)
+#else
+static int pca9685_probe(struct i2c_client *client)
+#endif
+{
+    struct pca9685_dev *pd;
+    int minor, ret;
+
+    // I2C 가 안 되면 최소한 SMBus I2C block 과 byte data 는 있어야 한다.
+    if (!i2c_check_functionality(client->adapter, I2C_FUNC_I2C) &&
+        !i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_I2C_BLOCK | I2C_FUNC_SMBUS_BYTE_DATA))
+        return -ENODEV;
+
+    // 열린 파일이 remove 뒤에도 쓸 수 있도록 devm 이 아니라 kref 로 수명을 관리한다.
+    pd = kzalloc(sizeof(*pd), GFP_KERNEL);
+    if (!pd)
+        return -ENOMEM;
+    pd->client = client;
+    mutex_init(&pd->lock);
+    kref_init(&pd->ref);
+    i2c_set_clientdata(client, pd);
+
+    ret = chip_init(pd);
+    if (ret) {
+        dev_err(&client->dev, "Failed to init chip (%d)\n", ret);
+        goto err_free;
+    }
+
+    mutex_lock(&devs_lock);
+    for (minor = 0; minor < PCA9685_MINORS && devs[minor]; minor++)
+        ;
+    if (minor == PCA9685_MINORS) {
+        mutex_unlock(&devs_lock);
+        ret = -EBUSY;
+        goto err_free;
+    }
+    devs[minor] = pd;
+    mutex_unlock(&devs_lock);
+    pd->minor = minor;
+
+    // pwm_chip 을 먼저 붙인다. cdev_add 뒤에는 노드가 열릴 수 있으므로 그 뒤로는 실패할 일이 없게 한다.
+    if (use_pwm) {
+        ret = pwm_register(pd);
+        if (ret)
+            goto err_minor;
+    }
+
+    // cdev 는 따로 할당해 두어야 pd 보다 먼저/나중에 풀려도 서로 걸리지 않는다.
+    pd->cdev = cdev_alloc();
+    if (!pd->cdev) {
+        ret = -ENOMEM;
+        goto err_pwm;
+    }
+    pd->cdev->ops = &pca9685_fops;
+    pd->cdev->owner = THIS_MODULE;
+    ret = cdev_add(pd->cdev, MKDEV(PCA9685_MAJOR, minor), 1);
+    if (ret)
+        goto err_cdev;
+
+    dev_info(&client->dev, "'mknod /dev/%s%d c %d %d', prescale %d\n",
+             PCA9685_DEVICE, minor, PCA9685_MAJOR, minor, pd->prescale);
+    return 0;
+
+err_cdev:
+    // cdev_add 가 실패한 경우라 열린 파일은 없지만, 있더라도 remove 와 같이 막아 둔다.
+    mutex_lock(&pd->lock);
+    pd->removed = true;
+    mutex_unlock(&pd->lock);
+    cdev_del(pd->cdev);
+err_pwm:
+    if (use_pwm)
+        pwm_unregister(pd);
+err_minor:
+    mutex_lock(&devs_lock);
+    devs[minor] = NULL;
+    mutex_unlock(&devs_lock);
+err_free:
+    kref_put(&pd->ref, pca9685_dev_release);
+    return ret;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+static int pca9685_remove(struct i2c_client *client)
+#else
+static void pca9685_remove(struct i2c_client *client)
+#endif
+{
+    struct pca9685_dev *pd = i2c_get_clientdata(client);
+
+    if (use_pwm)
+        pwm_unregister(pd);
+    cdev_del(pd->cdev);
+    mutex_lock(&devs_lock);
+    devs[pd->minor] = NULL;
+    mutex_unlock(&devs_lock);
+
+    // 아직 열린 파일이 있으면 pd 는 마지막 close 에서 풀린다.
+    mutex_lock(&pd->lock);
+    pd->removed = true;
+    mutex_unlock(&pd->lock);
+    kref_put(&pd->ref, pca9685_dev_release);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+    return 0;
+#endif
+}
+
+// 커널의 pwm-pca9685 와 겹치지 않도록 다른 이름을 쓴다.
+static const struct i2c_device_id pca9685_id[] = {
+    { "pca9685_dd", 0 },
+    { }
+};
+MODULE_DEVICE_TABLE(i2c, pca9685_id);
+
+static struct i2c_driver pca9685_driver = {
+    .driver = {
+        .name = "pca9685_dd",
+    },
+    .probe    = pca9685_probe,
+    .remove   = pca9685_remove,
+    .id_table = pca9685_id,
+};
+
+int PCA9685_init(void)
+{
+    dev_t devno = MKDEV(PCA9685_MAJOR, 0);
+    int err;
+
+    printk(KERN_INFO "PCA9685_init!\n");
+
+    //===========================================================
+    // minor 0 ~ PCA9685_MINORS-1 을 예약한다. cdev 는 칩이 probe 될 때 만든다.
+    //===========================================================
+    err = register_chrdev_region(devno, PCA9685_MINORS, PCA9685_DEVICE);
+    if (err < 0) {
+        printk("Error : Device Region\n");
+        return err;
+    }
+
+    err = i2c_add_driver(&pca9685_driver);
+    if (err < 0) {
+        printk("Error : I2C Driver Add\n");
+        unregister_chrdev_region(devno, PCA9685_MINORS);
+        return err;
+    }
+    return 0;
+}
+
+void PCA9685_exit(void)
+{
+    i2c_del_driver(&pca9685_driver);
+    unregister_chrdev_region(MKDEV(PCA9685_MAJOR, 0), PCA9685_MINORS);
+    printk(KERN_INFO "PCA9685_exit\n");
+}
+
+module_init(PCA9685_init);
+module_exit(PCA9685_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Heejin Park");
+MODULE_DESCRIPTION("PCA9685 I2C PWM Frame Driver");
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pca9685_queue.h"
+
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+#define NSEC 1000000000L
+
+struct pca9685_bus *pca9685_bus_create(struct pca9685 **dev, int ndev, int rate_hz)
+{
+	struct pca9685_bus *bus;
+	size_t i;
+
+	if(ndev <= 0 || ndev > FLEET_MAX || rate_hz <= 0)
+		return NULL;
+	bus = calloc(1, sizeof(*bus));
+	if(bus == NULL)
+		return NULL;
+	for(i = 0; i < QUEUE_SIZE; i++)
+		atomic_init(&bus->cell[i].seq, i);
+	atomic_init(&bus->head, 0);
+	memcpy(bus->dev, dev, ndev * sizeof(*dev));
+	bus->ndev = ndev;
+	bus->rate_hz = rate_hz;
+	return bus;
+}
+
+void pca9685_bus_destroy(struct pca9685_bus *bus)
+{
+	if(bus == NULL)
+		return;
+	pca9685_bus_stop(bus);
+	free(bus);
+}
+
+// 여러 스레드가 동시에 불러도 된다. 큐가 가득 차면 기다리지 않고 -1
+int pca9685_bus_post(struct pca9685_bus *bus, int dev, int ch, int value)
+{
+	struct queue_cell *cell;
+	size_t pos, seq;
+	intptr_t diff;
+
+	if(dev < 0 || dev >= bus->ndev || ch < 0 || ch >= LED_NUM)
+		return -1;
+
+	pos = atomic_load_explicit(&bus->head, memory_order_relaxed);
+	while(1){
+		cell = &bus->cell[pos & QUEUE_MASK];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if(diff == 0){
+			// 이 칸을 차지한다. 실패하면 pos 가 최신 head 로 바뀐다.
+			if(atomic_compare_exchange_weak_explicit(&bus->head, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if(diff < 0){
+			atomic_fetch_add_explicit(&bus->dropped, 1, memory_order_relaxed);
+			return -1;
+		}
+		else
+			pos = atomic_load_explicit(&bus->head, memory_order_relaxed);
+	}
+
+	cell->sp.dev = dev;
+	cell->sp.ch = ch;
+	cell->sp.value = value < 0 ? 0 : value > DUTY_FULL ? DUTY_FULL : value;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	atomic_fetch_add_explicit(&bus->posted, 1, memory_order_relaxed);
+	return 0;
+}
+
+// bus 스레드 전용: 큐를 비우고 채널마다 마지막 값만 shadow 에 넣은 뒤 flush 한다.
+int pca9685_bus_drain(struct pca9685_bus *bus)
+{
+	struct queue_cell *cell;
+	struct setpoint sp;
+	int d, ch, ret = 0;
+
+	while(1){
+		cell = &bus->cell[bus->tail & QUEUE_MASK];
+		if(atomic_load_explicit(&cell->seq, memory_order_acquire) != bus->tail + 1)
+			break;
+		sp = cell->sp;
+		atomic_store_explicit(&cell->seq, bus->tail + QUEUE_SIZE, memory_order_release);
+		bus->tail++;
+
+		if(bus->pending_mask[sp.dev] & (1u << sp.ch))
+			bus->coalesced++;
+		bus->pending[sp.dev][sp.ch] = sp.value;
+		bus->pending_mask[sp.dev] |= 1u << sp.ch;
+	}
+
+	for(d = 0; d < bus->ndev; d++){
+		for(ch = 0; ch < LED_NUM && bus->pending_mask[d]; ch++){
+			if(bus->pending_mask[d] & (1u << ch))
+				pca9685_set_duty(bus->dev[d], ch, bus->pending[d][ch]);
+		}
+		bus->pending_mask[d] = 0;
+	}
+
+	if(bus->fleet)
+		ret = pca9685_fleet_flush(bus->fleet) < 0 ? -1 : 0;
+	else{
+		for(d = 0; d < bus->ndev; d++)
+			if(pca9685_flush(bus->dev[d]) < 0)
+				ret = -1;
+	}
+	bus->frames++;
+	return ret;
+}
+
+static void *bus_thread(void *arg)
+{
+	struct pca9685_bus *bus = arg;
+	struct timespec ts;
+	long period = NSEC / bus->rate_hz;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while(atomic_load(&bus->running)){
+		if(pca9685_bus_drain(bus) < 0)
+			bus->errors++;
+
+		ts.tv_nsec += period;
+		while(ts.tv_nsec >= NSEC){
+			ts.tv_sec++;
+			ts.tv_nsec -= NSEC;
+		}
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+	}
+	// 멈추기 전에 남은 setpoint 를 보낸다.
+	if(pca9685_bus_drain(bus) < 0)
+		bus->errors++;
+	return NULL;
+}
+
+int pca9685_bus_start(struct pca9685_bus *bus)
+{
+	atomic_store(&bus->running, 1);
+	if(pthread_create(&bus->thread, NULL, bus_thread, bus) != 0){
+		printf("Failed to create bus thread\n");
+		atomic_store(&bus->running, 0);
+		return -1;
+	}
+	return 0;
+}
+
+void pca9685_bus_stop(struct pca9685_bus *bus)
+{
+	if(!atomic_exchange(&bus->running, 0))
+		return;
+	pthread_join(bus->thread, NULL);
+}
@@ -0,0 +1,58 @@
+#ifndef PCA9685_QUEUE_H
+#define PCA9685_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "pca9685.h"
+#include "pca9685_fleet.h"
+
+#define QUEUE_SIZE 1024		// 2의 거듭제곱
+
+struct setpoint {
+	uint16_t dev;
+	uint16_t ch;
+	uint16_t value;		// duty (0 ~ DUTY_FULL)
+};
+
+struct queue_cell {
+	atomic_size_t seq;
+	struct setpoint sp;
+};
+
+// /dev/i2c-N 하나를 혼자 쓰는 bus 스레드와, 여러 스레드가 setpoint 를 넣는 lock-free 큐.
+// 생산자는 큐에 넣기만 하고 I2C 를 기다리지 않는다. bus 스레드는 프레임마다 큐를 비우면서
+// 같은 채널의 값은 마지막 것만 남기고(last-writer-wins), 장치마다 flush 한 번을 보낸다.
+struct pca9685_bus {
+	struct queue_cell cell[QUEUE_SIZE];
+	atomic_size_t head;	// 생산자들이 CAS 로 올린다
+	size_t tail;		// bus 스레드만 쓴다
+
+	struct pca9685 *dev[FLEET_MAX];
+	int ndev;
+	struct pca9685_fleet *fleet;	// 설정하면 fleet flush 한 번으로 보낸다
+	int rate_hz;
+
+	uint16_t pending[FLEET_MAX][LED_NUM];
+	uint16_t pending_mask[FLEET_MAX];
+
+	pthread_t thread;
+	atomic_int running;
+
+	atomic_ulong posted;
+	atomic_ulong dropped;		// 큐가 가득 차서 버린 setpoint
+	unsigned long coalesced;	// flush 전에 덮어쓴 setpoint
+	unsigned long frames;
+	unsigned long errors;		// flush 가 실패한 프레임
+};
+
+struct pca9685_bus *pca9685_bus_create(struct pca9685 **dev, int ndev, int rate_hz);
+void pca9685_bus_destroy(struct pca9685_bus *bus);
+int pca9685_bus_start(struct pca9685_bus *bus);
+void pca9685_bus_stop(struct pca9685_bus *bus);
+int pca9685_bus_post(struct pca9685_bus *bus, int dev, int ch, int value);
+int pca9685_bus_drain(struct pca9685_bus *bus);
+
+#endif
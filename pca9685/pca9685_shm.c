@@ -0,0 +1,188 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pca9685_shm.h"
+
+#define NSEC 1000000000L
+
+static struct pca9685_shm *shm_map(const char *name, int fd, size_t size, int owner)
+{
+	struct pca9685_shm *shm;
+	void *map;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED){
+		printf("Failed to mmap %s\n", name);
+		return NULL;
+	}
+	shm = calloc(1, sizeof(*shm));
+	if(shm == NULL){
+		munmap(map, size);
+		return NULL;
+	}
+	shm->fd = fd;
+	shm->owner = owner;
+	shm->size = size;
+	shm->table = map;
+	snprintf(shm->name, sizeof(shm->name), "%s", name);
+	return shm;
+}
+
+// 데몬 쪽: 테이블을 만든다.
+struct pca9685_shm *pca9685_shm_create(const char *name, int nboard, int rate_hz)
+{
+	struct pca9685_shm *shm;
+	size_t size;
+	int fd, i, ch;
+
+	if(nboard <= 0 || nboard > FLEET_MAX)
+		return NULL;
+	size = sizeof(struct pca9685_shm_table) + nboard * sizeof(struct shm_board);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if(fd < 0 || ftruncate(fd, size) < 0){
+		printf("Failed to create shared memory %s\n", name);
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	shm = shm_map(name, fd, size, 1);
+	if(shm == NULL){
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	for(i = 0; i < nboard; i++){
+		atomic_init(&shm->table->board[i].seq, 0);
+		atomic_init(&shm->table->board[i].dirty, 0);
+		for(ch = 0; ch < LED_NUM; ch++)
+			atomic_init(&shm->table->board[i].ch[ch], 0);
+	}
+	shm->table->nboard = nboard;
+	shm->table->rate_hz = rate_hz;
+	shm->table->version = SHM_VERSION;
+	// magic 을 마지막에 써서 초기화가 끝난 테이블만 attach 되게 한다.
+	atomic_thread_fence(memory_order_release);
+	shm->table->magic = SHM_MAGIC;
+	return shm;
+}
+
+// 클라이언트 쪽: 데몬이 만든 테이블에 붙는다.
+struct pca9685_shm *pca9685_shm_attach(const char *name)
+{
+	struct pca9685_shm *shm;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if(fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct pca9685_shm_table)){
+		printf("Failed to open shared memory %s\n", name);
+		if(fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	shm = shm_map(name, fd, st.st_size, 0);
+	if(shm == NULL){
+		close(fd);
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	if(shm->table->magic != SHM_MAGIC || shm->table->version != SHM_VERSION ||
+			sizeof(struct pca9685_shm_table) + shm->table->nboard * sizeof(struct shm_board) > shm->size){
+		printf("Bad shared memory table %s\n", name);
+		pca9685_shm_close(shm);
+		return NULL;
+	}
+	return shm;
+}
+
+void pca9685_shm_close(struct pca9685_shm *shm)
+{
+	if(shm == NULL)
+		return;
+	munmap(shm->table, shm->size);
+	close(shm->fd);
+	if(shm->owner)
+		shm_unlink(shm->name);
+	free(shm);
+}
+
+// 시스템 콜 없이 값만 써 넣는다. 여러 프로세스가 동시에 불러도 된다.
+int pca9685_shm_set(struct pca9685_shm *shm, int board, int ch, int value)
+{
+	struct shm_board *b;
+
+	if(board < 0 || board >= (int)shm->table->nboard || ch < 0 || ch >= LED_NUM)
+		return -1;
+	if(value < 0)
+		value = 0;
+	if(value > DUTY_FULL)
+		value = DUTY_FULL;
+	b = &shm->table->board[board];
+	atomic_store_explicit(&b->ch[ch], value, memory_order_relaxed);
+	atomic_fetch_or_explicit(&b->dirty, 1u << ch, memory_order_release);
+	atomic_fetch_add_explicit(&b->seq, 1, memory_order_relaxed);
+	return 0;
+}
+
+// 데몬 쪽: 써 넣은 채널만 shadow 에 반영하고 프레임으로 commit 한다. 반환값은 보낸 보드 수
+// 테이블의 나머지 채널은 0 이어도 쓰지 않으므로 데몬 밖에서 켜 둔 출력이 유지된다.
+int pca9685_shm_poll(struct pca9685_shm *shm, struct pca9685 **dev, int ndev)
+{
+	struct shm_board *b;
+	uint32_t dirty;
+	int i, ch, n = 0;
+
+	for(i = 0; i < ndev && i < (int)shm->table->nboard; i++){
+		b = &shm->table->board[i];
+		if(atomic_load_explicit(&b->dirty, memory_order_relaxed) == 0)
+			continue;
+		// 읽는 도중 값이 더 바뀌면 dirty 도 다시 켜지므로 다음 poll 에서 또 읽힌다.
+		dirty = atomic_exchange_explicit(&b->dirty, 0, memory_order_acquire);
+		for(ch = 0; ch < LED_NUM; ch++)
+			if(dirty & (1u << ch))
+				pca9685_set_duty(dev[i], ch, atomic_load_explicit(&b->ch[ch], memory_order_relaxed) & 0xffff);
+		if(pca9685_commit(dev[i]) < 0)
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+// stats_sec 가 0 이 아니면 그 주기로 장치 통계를 출력한다.
+int pca9685_shm_run(struct pca9685_shm *shm, struct pca9685 **dev, int ndev, int stats_sec, volatile sig_atomic_t *stop)
+{
+	struct timespec ts;
+	long period, frames = 0;
+	int i;
+
+	if(shm->table->rate_hz == 0)
+		return -1;
+	period = NSEC / shm->table->rate_hz;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while(!*stop){
+		if(pca9685_shm_poll(shm, dev, ndev) < 0)
+			return -1;
+		for(i = 0; i < ndev; i++)
+			if(pca9685_check(dev[i], period / 1000) < 0)
+				return -1;
+		if(stats_sec > 0 && ++frames % ((long)stats_sec * shm->table->rate_hz) == 0){
+			for(i = 0; i < ndev; i++)
+				pca9685_print_stats(dev[i]);
+		}
+		ts.tv_nsec += period;
+		while(ts.tv_nsec >= NSEC){
+			ts.tv_sec++;
+			ts.tv_nsec -= NSEC;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	return 0;
+}
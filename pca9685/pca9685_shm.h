@@ -0,0 +1,49 @@
+#ifndef PCA9685_SHM_H
+#define PCA9685_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <signal.h>
+
+#include "pca9685.h"
+#include "pca9685_fleet.h"
+
+#define SHM_NAME "/pca9685"
+#define SHM_MAGIC 0x50434139	// "PCA9"
+#define SHM_VERSION 2
+
+struct shm_board {
+	atomic_uint seq;		// 보드 안의 채널이 바뀔 때마다 증가
+	atomic_uint dirty;		// 데몬이 아직 반영하지 않은 채널 (bit n = 채널 n)
+	atomic_uint ch[LED_NUM];	// 하위 16bit: duty (0 ~ DUTY_FULL)
+};
+
+// shm_open 으로 만든 공유 메모리의 배치. 프로세스 사이에서 lock-free atomic 으로만 접근한다.
+struct pca9685_shm_table {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nboard;
+	uint32_t rate_hz;
+	struct shm_board board[];
+};
+
+// 데몬만 버스를 쓰고, 다른 프로세스는 테이블에 값만 써 넣는다(시스템 콜 없음).
+// 데몬은 rate_hz 마다 써 넣은 채널만 shadow 에 반영해 commit 한다. 나머지 채널은 그대로 둔다.
+struct pca9685_shm {
+	int fd;
+	int owner;		// 만든 쪽이면 close 시 shm_unlink
+	char name[32];
+	size_t size;
+	struct pca9685_shm_table *table;
+};
+
+struct pca9685_shm *pca9685_shm_create(const char *name, int nboard, int rate_hz);
+struct pca9685_shm *pca9685_shm_attach(const char *name);
+void pca9685_shm_close(struct pca9685_shm *shm);
+
+int pca9685_shm_set(struct pca9685_shm *shm, int board, int ch, int value);
+int pca9685_shm_poll(struct pca9685_shm *shm, struct pca9685 **dev, int ndev);
+int pca9685_shm_run(struct pca9685_shm *shm, struct pca9685 **dev, int ndev, int stats_sec, volatile sig_atomic_t *stop);
+
+#endif
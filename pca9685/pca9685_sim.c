@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pca9685_sim.h"
+
+static struct pca9685_sim *sims;
+static pthread_mutex_t sims_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 데이터시트의 power-on reset 값
+static void chip_por(struct pca9685_sim_chip *chip)
+{
+	int ch;
+
+	memset(chip->regs, 0, sizeof(chip->regs));
+	chip->regs[MODE1] = MODE1_SLEEP | MODE1_ALLCALL;
+	chip->regs[MODE2] = MODE2_OUTDRV;
+	chip->regs[SUBADR1] = 0xE2;
+	chip->regs[SUBADR2] = 0xE4;
+	chip->regs[SUBADR3] = 0xE8;
+	chip->regs[ALLCALLADR] = 0xE0;
+	for(ch = 0; ch < LED_NUM; ch++)
+		chip->regs[LED_REG(ch) + 3] = LED_FULL;
+	chip->regs[PRE_SCALE] = 0x1E;
+	memcpy(chip->out, &chip->regs[LED0_ON_L], sizeof(chip->out));
+	chip->staged = 0;
+	chip->paused = 0;
+	chip->wake_ns = 0;
+}
+
+// 이름이 같은 가상 버스를 찾고, 없으면 만든다.
+struct pca9685_sim *pca9685_sim_get(const char *name)
+{
+	struct pca9685_sim *sim;
+
+	pthread_mutex_lock(&sims_lock);
+	for(sim = sims; sim; sim = sim->next)
+		if(!strcmp(sim->name, name))
+			break;
+	if(sim == NULL && (sim = calloc(1, sizeof(*sim))) != NULL){
+		snprintf(sim->name, sizeof(sim->name), "%s", name);
+		pthread_mutex_init(&sim->lock, NULL);
+		sim->bus_hz = BUS_HZ;
+		sim->next = sims;
+		sims = sim;
+	}
+	pthread_mutex_unlock(&sims_lock);
+	return sim;
+}
+
+struct pca9685_sim_chip *pca9685_sim_chip(struct pca9685_sim *sim, int addr)
+{
+	int i;
+
+	for(i = 0; i < sim->nchip; i++)
+		if(sim->chip[i].addr == addr)
+			return &sim->chip[i];
+	return NULL;
+}
+
+struct pca9685_sim_chip *pca9685_sim_add(struct pca9685_sim *sim, int addr)
+{
+	struct pca9685_sim_chip *chip;
+
+	pthread_mutex_lock(&sim->lock);
+	chip = pca9685_sim_chip(sim, addr);
+	if(chip == NULL && sim->nchip < FLEET_MAX){
+		chip = &sim->chip[sim->nchip++];
+		memset(chip, 0, sizeof(*chip));
+		chip->addr = addr;
+		chip_por(chip);
+	}
+	pthread_mutex_unlock(&sim->lock);
+	return chip;
+}
+
+// 모든 칩을 전원 재투입 상태로 되돌리고 버스 통계를 지운다.
+void pca9685_sim_reset(struct pca9685_sim *sim)
+{
+	int i;
+
+	pthread_mutex_lock(&sim->lock);
+	for(i = 0; i < sim->nchip; i++)
+		chip_por(&sim->chip[i]);
+	sim->stops = sim->wire_bytes = sim->naks = 0;
+	sim->bus_ns = 0;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+// 직접 주소 외에 ALLCALL 과 켜져 있는 SUBADRn 에도 응답한다(쓰기만).
+static int responds(struct pca9685_sim_chip *chip, int addr, int read)
+{
+	int n;
+
+	if(chip->addr == addr)
+		return 1;
+	if(read)
+		return 0;
+	if((chip->regs[MODE1] & MODE1_ALLCALL) && chip->regs[ALLCALLADR] >> 1 == addr)
+		return 1;
+	for(n = 0; n < 3; n++)
+		if((chip->regs[MODE1] & (MODE1_SUB1 >> n)) && chip->regs[SUBADR1 + n] >> 1 == addr)
+			return 1;
+	return 0;
+}
+
+static int channel_active(struct pca9685_sim_chip *chip)
+{
+	int ch;
+
+	for(ch = 0; ch < LED_NUM; ch++)
+		if(!(chip->regs[LED_REG(ch) + 3] & LED_FULL))
+			return 1;
+	return 0;
+}
+
+static void mode1_write(struct pca9685_sim_chip *chip, uint8_t val)
+{
+	uint8_t old = chip->regs[MODE1];
+
+	if(!(old & MODE1_SLEEP) && (val & MODE1_SLEEP) && channel_active(chip))
+		chip->paused = 1;
+	if((old & MODE1_SLEEP) && !(val & MODE1_SLEEP))
+		chip->wake_ns = now_ns();
+	// RESTART 에 1 을 쓰면 멈췄던 PWM 이 재개된다. 0 을 쓰는 것은 효과가 없다.
+	if((val & MODE1_RESTART) && chip->paused && !(val & MODE1_SLEEP)){
+		if(now_ns() - chip->wake_ns < OSC_SETTLE_US * 1000ULL)
+			chip->settle_errors++;
+		chip->paused = 0;
+	}
+	chip->regs[MODE1] = (val & ~MODE1_RESTART) | (chip->paused ? MODE1_RESTART : 0);
+}
+
+// 출력에 LEDn 레지스터를 반영한다. len 은 4(채널 하나) 또는 LED_NUM * 4
+static void latch(struct pca9685_sim *sim, struct pca9685_sim_chip *chip, int off, int len)
+{
+	memcpy(&chip->out[off], &chip->regs[LED0_ON_L + off], len);
+	chip->latch_stop = sim->stops;
+	chip->latches++;
+}
+
+static void reg_write(struct pca9685_sim *sim, struct pca9685_sim_chip *chip, int reg, uint8_t val)
+{
+	int ch;
+
+	if(reg == MODE1)
+		mode1_write(chip, val);
+	else if(reg >= LED0_ON_L && reg < LED0_ON_L + LED_NUM * 4){
+		// ON_H/OFF_H 의 bit 7:5 는 예약 비트
+		chip->regs[reg] = (reg - LED0_ON_L) & 1 ? val & 0x1f : val;
+		// OCH = 1 이면 채널의 마지막 바이트(OFF_H) ACK 에서 그 채널이 바뀐다. 아니면 STOP 까지 기다린다.
+		if(!(chip->regs[MODE2] & MODE2_OCH))
+			chip->staged = 1;
+		else if((reg - LED0_ON_L) % 4 == 3)
+			latch(sim, chip, reg - 3 - LED0_ON_L, 4);
+		// SLEEP 이 아닐 때 PWM 레지스터를 쓰면 RESTART 대기가 풀린다.
+		if(chip->paused && !(chip->regs[MODE1] & MODE1_SLEEP)){
+			chip->paused = 0;
+			chip->regs[MODE1] &= ~MODE1_RESTART;
+		}
+	}
+	else if(reg >= ALL_LED_ON_L && reg <= ALL_LED_OFF_H){
+		for(ch = 0; ch < LED_NUM; ch++)
+			reg_write(sim, chip, LED_REG(ch) + reg - ALL_LED_ON_L, val);
+	}
+	else if(reg == PRE_SCALE){
+		// PRE_SCALE 은 SLEEP 중에만 바뀐다.
+		if(chip->regs[MODE1] & MODE1_SLEEP)
+			chip->regs[reg] = val < PRESCALE_MIN ? PRESCALE_MIN : val;
+		else
+			chip->prescale_ignored++;
+	}
+	else if(reg < REG_FILE_SIZE)
+		chip->regs[reg] = val;
+	// 0x46 ~ 0xF9 예약 영역과 TestMode(0xFF)는 무시한다.
+}
+
+static uint8_t reg_read(struct pca9685_sim_chip *chip, int reg)
+{
+	if(reg < REG_FILE_SIZE || reg == PRE_SCALE)
+		return chip->regs[reg];
+	return 0;	// ALL_LED_* 와 예약 영역은 0 으로 읽힌다
+}
+
+// AI 가 켜져 있으면 0x45 와 0xFF 다음은 0x00 으로 돌아간다. 꺼져 있으면 포인터가 그대로다.
+static int reg_next(struct pca9685_sim_chip *chip, int reg)
+{
+	if(!(chip->regs[MODE1] & MODE1_AI))
+		return reg;
+	if(reg == REG_FILE_SIZE - 1 || reg == REG_NUM - 1)
+		return 0;
+	return reg + 1;
+}
+
+// xfer 한 번을 START ... STOP 한 번으로 본다(메시지 사이는 repeated start).
+static int sim_xfer(struct pca9685 *dev, struct pca9685_msg *msgs, int n)
+{
+	struct pca9685_sim *sim = dev->priv;
+	struct pca9685_sim_chip *chip;
+	unsigned long wire = 0;
+	int i, j, c, reg, found, ret = 0;
+
+	pthread_mutex_lock(&sim->lock);
+	for(i = 0; i < n && ret == 0; i++){
+		// 주소 + 레지스터 포인터, 읽기면 repeated start 뒤 주소를 한 번 더
+		wire += 2 + msgs[i].read + msgs[i].len;
+		for(c = 0, found = 0; c < sim->nchip; c++){
+			chip = &sim->chip[c];
+			if(!responds(chip, msgs[i].addr, msgs[i].read))
+				continue;
+			found++;
+			reg = msgs[i].reg;
+			for(j = 0; j < msgs[i].len; j++){
+				if(msgs[i].read)
+					msgs[i].buf[j] = reg_read(chip, reg);
+				else
+					reg_write(sim, chip, reg, msgs[i].buf[j]);
+				reg = reg_next(chip, reg);
+			}
+			if(msgs[i].read)
+				chip->reads += msgs[i].len;
+			else
+				chip->writes += msgs[i].len;
+		}
+		// 아무도 ACK 하지 않으면 그 자리에서 전송이 끝난다.
+		if(found == 0){
+			sim->naks++;
+			errno = ENXIO;
+			ret = -1;
+		}
+	}
+	// NAK 로 끊겨도 master 는 STOP 을 낸다. OCH = 0 인 칩은 여기서 받은 LEDn 을 함께 출력한다.
+	for(c = 0; c < sim->nchip; c++){
+		chip = &sim->chip[c];
+		if(chip->staged){
+			latch(sim, chip, 0, sizeof(chip->out));
+			chip->staged = 0;
+		}
+	}
+	sim->stops++;
+	sim->wire_bytes += wire;
+	sim->bus_ns += wire * 9 * 1000000000ULL / sim->bus_hz;
+	pthread_mutex_unlock(&sim->lock);
+	dev->stats.syscalls++;
+	return ret;
+}
+
+const struct pca9685_backend pca9685_backend_sim = {
+	.name = "sim",
+	.funcs = 0,
+	.xfer = sim_xfer,
+};
+
+// pca9685_open() 에서 버스 이름이 SIM_PREFIX 로 시작하면 부른다.
+// 그 주소의 칩이 없으면 만든다. 단, ALLCALL 주소(fleet 버스 핸들)는 칩이 아니다.
+int pca9685_sim_attach(struct pca9685 *dev)
+{
+	struct pca9685_sim *sim;
+
+	sim = pca9685_sim_get(dev->bus);
+	if(sim == NULL)
+		return -1;
+	if(dev->addr != ALLCALL_ADDR && pca9685_sim_add(sim, dev->addr) == NULL)
+		return -1;
+	dev->fd = -1;
+	dev->funcs = 0;
+	dev->priv = sim;
+	dev->backend = &pca9685_backend_sim;
+	return 0;
+}
+
+uint32_t pca9685_sim_period_ns(struct pca9685_sim_chip *chip)
+{
+	return 4096ULL * (chip->regs[PRE_SCALE] + 1) * 1000000000ULL / CLOCK_FREQ;
+}
+
+// tick(0 ~ 4095) 시점의 출력 레벨. 레지스터가 아니라 출력에 반영된 값을 본다.
+int pca9685_sim_level(struct pca9685_sim_chip *chip, int ch, int tick)
+{
+	uint8_t *led = &chip->out[ch * 4];
+	int on = (led[1] & 0x0f) << 8 | led[0];
+	int off = (led[3] & 0x0f) << 8 | led[2];
+	int v;
+
+	if((chip->regs[MODE1] & MODE1_SLEEP) || chip->paused)
+		v = 0;
+	else if(led[3] & LED_FULL)
+		v = 0;
+	else if(led[1] & LED_FULL)
+		v = 1;
+	else if(on == off)
+		v = 0;
+	else if(on < off)
+		v = tick >= on && tick < off;
+	else
+		v = tick >= on || tick < off;
+	if(chip->regs[MODE2] & MODE2_INVRT)
+		v = !v;
+	return v;
+}
+
+// 한 PWM 주기 동안의 채널별 출력 변화를 시간 순으로 채운다. 반환값은 edge 수
+// full on/off 나 멈춘 채널은 변화가 없으므로 pca9685_sim_level() 로 본다.
+int pca9685_sim_timeline(struct pca9685_sim_chip *chip, struct sim_edge *edges, int max)
+{
+	uint32_t period = pca9685_sim_period_ns(chip);
+	struct sim_edge e;
+	uint8_t *led;
+	int ch, k, i, n = 0, tick, level;
+
+	for(ch = 0; ch < LED_NUM; ch++){
+		led = &chip->out[ch * 4];
+		for(k = 0; k < 2; k++){
+			tick = (led[k * 2 + 1] & 0x0f) << 8 | led[k * 2];
+			level = pca9685_sim_level(chip, ch, tick);
+			if(level == pca9685_sim_level(chip, ch, (tick + DUTY_FULL - 1) % DUTY_FULL))
+				continue;
+			if(n == max)
+				return n;
+			e.ns = (uint64_t)tick * period / DUTY_FULL;
+			e.ch = ch;
+			e.level = level;
+			// 삽입 정렬: edge 는 최대 32개
+			for(i = n++; i > 0 && edges[i - 1].ns > e.ns; i--)
+				edges[i] = edges[i - 1];
+			edges[i] = e;
+		}
+	}
+	return n;
+}
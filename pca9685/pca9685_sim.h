@@ -0,0 +1,64 @@
+#ifndef PCA9685_SIM_H
+#define PCA9685_SIM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pca9685.h"
+#include "pca9685_fleet.h"
+
+#define SIM_PREFIX "sim"	// pca9685_open("sim...", addr) 이면 프로세스 안의 가상 버스에 붙는다
+
+// 가상 PCA9685 한 개. 레지스터 파일과 발진기 상태만 가진다.
+struct pca9685_sim_chip {
+	int addr;
+	uint8_t regs[REG_NUM];
+	int paused;		// SLEEP 으로 멈춘 PWM 이 RESTART 를 기다리는 중
+	uint64_t wake_ns;	// SLEEP 을 푼 시각 (RESTART 는 OSC_SETTLE_US 뒤에만 유효)
+	uint8_t out[LED_NUM * 4];	// 출력에 반영된 LEDn 레지스터 (MODE2 OCH 에 따라 STOP/ACK 에서 갱신)
+	int staged;		// 이번 전송에서 LEDn 을 받아 STOP 을 기다리는 중
+	unsigned long latch_stop;	// 마지막으로 출력이 바뀐 전송 번호 (sim->stops 기준)
+
+	unsigned long writes;		// 이 칩이 받은 데이터 바이트
+	unsigned long reads;
+	unsigned long prescale_ignored;	// SLEEP 이 아닐 때 PRE_SCALE 에 쓴 횟수
+	unsigned long settle_errors;	// 발진기 안정 전에 RESTART 를 쓴 횟수
+	unsigned long latches;		// 출력이 바뀐 횟수 (STOP 또는 채널 ACK 마다)
+};
+
+// 가상 I2C 버스. 주소(직접/ALLCALL/SUBADRn)로 칩을 골라 전달한다.
+struct pca9685_sim {
+	char name[32];
+	pthread_mutex_t lock;
+	struct pca9685_sim_chip chip[FLEET_MAX];
+	int nchip;
+	int bus_hz;
+
+	unsigned long stops;	// STOP 으로 끝난 전송 수 (xfer 한 번 = STOP 한 번)
+	unsigned long wire_bytes;	// 주소 바이트를 포함해 선에 실린 바이트
+	unsigned long naks;	// 아무 칩도 응답하지 않은 주소
+	uint64_t bus_ns;	// wire_bytes 를 bus_hz 로 보냈을 때 걸리는 시간
+
+	struct pca9685_sim *next;
+};
+
+// 한 PWM 주기 안의 출력 변화 한 개
+struct sim_edge {
+	uint32_t ns;		// 주기 시작부터의 시간
+	uint8_t ch;
+	uint8_t level;
+};
+
+extern const struct pca9685_backend pca9685_backend_sim;
+
+int pca9685_sim_attach(struct pca9685 *dev);
+struct pca9685_sim *pca9685_sim_get(const char *name);
+struct pca9685_sim_chip *pca9685_sim_add(struct pca9685_sim *sim, int addr);
+struct pca9685_sim_chip *pca9685_sim_chip(struct pca9685_sim *sim, int addr);
+void pca9685_sim_reset(struct pca9685_sim *sim);
+
+uint32_t pca9685_sim_period_ns(struct pca9685_sim_chip *chip);
+int pca9685_sim_level(struct pca9685_sim_chip *chip, int ch, int tick);
+int pca9685_sim_timeline(struct pca9685_sim_chip *chip, struct sim_edge *edges, int max);
+
+#endif
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pca9685.h"
+#include "pca9685_anim.h"
+#include "pca9685_fleet.h"
+#include "pca9685_map.h"
+#include "pca9685_queue.h"
+#include "pca9685_shm.h"
+#include "pca9685_sim.h"
+
+// sim 버스 위에서 라이브러리 동작을 확인한다. 실패하면 0 이 아닌 값으로 끝난다.
+
+static int failed;
+
+#define CHECK(cond, ...) do{ if(!(cond)){ printf("FAIL %s:%d : ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failed++; } }while(0)
+
+// 장치에 실제로 써진 채널의 duty
+static int read_duty(struct pca9685 *dev, int ch)
+{
+	int on, off;
+
+	if(pca9685_led_read(dev, ch, &on, &off) < 0)
+		return -1;
+	if(off & (LED_FULL << 8))
+		return 0;
+	if(on & (LED_FULL << 8))
+		return DUTY_FULL;
+	return (off - on) & (DUTY_FULL - 1);
+}
+
+static struct pca9685_anim *anim_from(const char *text, struct pca9685 **dev, int ndev)
+{
+	char path[] = "/tmp/pca9685_test_XXXXXX";
+	struct pca9685_anim *anim;
+	int fd;
+
+	fd = mkstemp(path);
+	if(fd < 0)
+		return NULL;
+	if(write(fd, text, strlen(text)) < 0){
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	anim = pca9685_anim_open(path, dev, ndev);
+	unlink(path);
+	return anim;
+}
+
+// lookahead(1 초)보다 멀리 떨어진 keyframe 사이도 처음부터 보간해야 한다.
+static void test_anim_wide_keys(struct pca9685 *dev)
+{
+	struct pca9685_anim *anim;
+	uint32_t ms;
+	int duty, want;
+
+	anim = anim_from("0 0 0\n5000 0 4000\n", &dev, 1);
+	CHECK(anim != NULL, "open anim");
+	if(anim == NULL)
+		return;
+	for(ms = 0; ms <= 5000; ms += 10){
+		if(pca9685_anim_frame(anim, ms) < 0){
+			CHECK(0, "frame %u", ms);
+			break;
+		}
+		duty = read_duty(dev, 0);
+		want = 4000 * ms / 5000;
+		if(duty < want - 1 || duty > want + 1){
+			CHECK(0, "wide keys at %u ms : duty %d, want %d", ms, duty, want);
+			break;
+		}
+	}
+	pca9685_anim_close(anim);
+}
+
+// 한 채널의 keyframe 이 큐보다 많이 몰려 있어도 다른 채널의 다음 keyframe 은 읽혀야 한다.
+static void test_anim_full_queue(struct pca9685 *dev)
+{
+	struct pca9685_anim *anim;
+	char text[1024];
+	int i, n = 0, duty, ret;
+
+	n += sprintf(text + n, "0 1 0\n");
+	for(i = 0; i < ANIM_QUEUE * 4; i++)
+		n += sprintf(text + n, "%d 0 %d\n", i * 10, i * 100);
+	n += sprintf(text + n, "2000 1 2000\n3000 0 0\n");
+
+	anim = anim_from(text, &dev, 1);
+	CHECK(anim != NULL, "open anim");
+	if(anim == NULL)
+		return;
+	pca9685_anim_frame(anim, 0);
+	pca9685_anim_frame(anim, 100);
+	duty = read_duty(dev, 1);
+	CHECK(duty == 100, "channel 1 at 100 ms : duty %d, want 100", duty);
+	pca9685_anim_frame(anim, 200);
+	duty = read_duty(dev, 0);
+	CHECK(duty == 2000, "channel 0 at 200 ms : duty %d, want 2000", duty);
+	pca9685_anim_frame(anim, 310);
+	duty = read_duty(dev, 0);
+	CHECK(duty == 3100, "channel 0 at 310 ms : duty %d, want 3100", duty);
+
+	for(i = 400, ret = 0; i <= 4000 && ret == 0; i += 100)
+		ret = pca9685_anim_frame(anim, i);
+	CHECK(ret == 1, "anim did not finish (%d)", ret);
+	CHECK(read_duty(dev, 0) == 0 && read_duty(dev, 1) == 2000, "final duty %d/%d", read_duty(dev, 0), read_duty(dev, 1));
+	pca9685_anim_close(anim);
+}
+
+// 테이블로 채널 하나를 써도 이미 돌던 다른 채널은 그대로여야 한다.
+static void test_shm_keeps_other_channels(struct pca9685 *dev)
+{
+	struct pca9685_shm *shm, *client;
+	char name[32];
+	int duty;
+
+	pca9685_set_duty(dev, 3, 1234);
+	if(pca9685_commit(dev) < 0){
+		CHECK(0, "commit");
+		return;
+	}
+	snprintf(name, sizeof(name), "/pca9685_test_%d", (int)getpid());
+	shm = pca9685_shm_create(name, 1, 100);
+	client = shm ? pca9685_shm_attach(name) : NULL;
+	CHECK(client != NULL, "open table %s", name);
+	if(client != NULL){
+		pca9685_shm_set(client, 0, 0, 500);
+		CHECK(pca9685_shm_poll(shm, &dev, 1) == 1, "poll did not send the board");
+		duty = read_duty(dev, 0);
+		CHECK(duty == 500, "written channel : duty %d, want 500", duty);
+		duty = read_duty(dev, 3);
+		CHECK(duty == 1234, "other channel : duty %d, want 1234", duty);
+		CHECK(pca9685_shm_poll(shm, &dev, 1) == 0, "clean table sent again");
+	}
+	pca9685_shm_close(client);
+	pca9685_shm_close(shm);
+}
+
+// ALLCALL 을 끈 보드가 있어도 fleet 주파수 변경은 모든 보드의 PRE_SCALE 에 들어가야 한다.
+static void test_fleet_frequency_without_allcall(void)
+{
+	struct pca9685_fleet *fleet;
+	struct pca9685 *dev;
+	uint8_t mode1, prescale;
+	int i;
+
+	fleet = pca9685_fleet_open(SIM_PREFIX "-fleet");
+	CHECK(fleet != NULL, "open fleet");
+	if(fleet == NULL)
+		return;
+	for(i = 0; i < 2; i++){
+		if(pca9685_fleet_add(fleet, 0x50 + i) < 0 || pca9685_init(fleet->board[i]) < 0){
+			CHECK(0, "add board %d", i);
+			pca9685_fleet_close(fleet);
+			return;
+		}
+	}
+	dev = fleet->board[1];
+	mode1 = dev->shadow[MODE1] & ~MODE1_ALLCALL;
+	pca9685_set(dev, MODE1, &mode1, 1);
+	CHECK(pca9685_flush(dev) >= 0, "clear ALLCALL");
+
+	CHECK(pca9685_fleet_set_frequency(fleet, 500, NULL) == 0, "set frequency");
+	for(i = 0; i < 2; i++){
+		CHECK(pca9685_read(fleet->board[i], PRE_SCALE, &prescale, 1) >= 0, "read PRE_SCALE");
+		CHECK(prescale == pca9685_prescale(500), "board %d PRE_SCALE %d, want %d", i, prescale, pca9685_prescale(500));
+	}
+	pca9685_fleet_close(fleet);
+}
+
+// LED 외의 레지스터가 함께 dirty 여도 fleet commit 은 모든 보드의 LED 구간을 실어야 한다.
+static void test_fleet_commit_mixed_dirty(void)
+{
+	struct pca9685_fleet *fleet;
+	struct pca9685 *dev;
+	uint8_t mode1, one = 1, prescale;
+	int i, duty;
+
+	fleet = pca9685_fleet_open(SIM_PREFIX "-commit");
+	CHECK(fleet != NULL, "open fleet");
+	if(fleet == NULL)
+		return;
+	for(i = 0; i < 2; i++){
+		if(pca9685_fleet_add(fleet, 0x50 + i) < 0 || pca9685_init(fleet->board[i]) < 0){
+			CHECK(0, "add board %d", i);
+			pca9685_fleet_close(fleet);
+			return;
+		}
+		fleet->board[i]->stagger = 0;
+	}
+	// MODE1, ALL_LED_ON_L, PRE_SCALE, LED 를 한꺼번에 바꾼다. ALL_LED_ON_L 과 PRE_SCALE 은
+	// FLUSH_GAP 보다 멀어 버스트가 둘로 나뉜다.
+	for(i = 0; i < 2; i++){
+		dev = fleet->board[i];
+		mode1 = dev->shadow[MODE1] | MODE1_SUB1;
+		prescale = dev->shadow[PRE_SCALE] + 1;	// 깨어 있는 칩은 무시하지만 dirty 는 된다
+		pca9685_set(dev, MODE1, &mode1, 1);
+		pca9685_set(dev, ALL_LED_ON_L, &one, 1);
+		pca9685_set(dev, PRE_SCALE, &prescale, 1);
+		pca9685_set_duty(dev, 5, 1000 + i);
+	}
+	CHECK(pca9685_fleet_commit(fleet) > 0, "fleet commit");
+	for(i = 0; i < 2; i++){
+		dev = fleet->board[i];
+		duty = read_duty(dev, 5);
+		CHECK(duty == 1000 + i, "board %d channel 5 : duty %d, want %d", i, duty, 1000 + i);
+		CHECK(pca9685_read(dev, MODE1, &mode1, 1) >= 0 && (mode1 & MODE1_SUB1), "board %d MODE1 0x%02x", i, mode1);
+	}
+	pca9685_fleet_close(fleet);
+}
+
+#define QT_THREADS 4
+#define QT_CH (LED_NUM / QT_THREADS)	// 생산자마다 맡는 채널 수
+
+struct queue_producer {
+	struct pca9685_bus *bus;
+	int id;
+	int rounds;
+	int ok;			// 성공한 post
+	int fail;		// 큐가 가득 차서 돌려받은 post
+};
+
+// 생산자마다 자기 채널에만 값을 올려 가며 넣는다. 채널 하나의 값은 한 스레드만 넣으므로
+// 큐 순서대로 보면 마지막 값이 정해진다.
+static void *queue_produce(void *arg)
+{
+	struct queue_producer *p = arg;
+	int r, k;
+
+	for(r = 0; r < p->rounds; r++){
+		for(k = 0; k < QT_CH; k++){
+			if(pca9685_bus_post(p->bus, 0, p->id * QT_CH + k, 100 + r * 10 + k) == 0)
+				p->ok++;
+			else
+				p->fail++;
+		}
+	}
+	return NULL;
+}
+
+static void queue_run(struct pca9685_bus *bus, struct queue_producer *p, int rounds)
+{
+	pthread_t th[QT_THREADS];
+	int i;
+
+	for(i = 0; i < QT_THREADS; i++){
+		memset(&p[i], 0, sizeof(p[i]));
+		p[i].bus = bus;
+		p[i].id = i;
+		p[i].rounds = rounds;
+		pthread_create(&th[i], NULL, queue_produce, &p[i]);
+	}
+	for(i = 0; i < QT_THREADS; i++)
+		pthread_join(th[i], NULL);
+}
+
+// 여러 생산자가 넣은 setpoint 가 채널마다 마지막 값으로 합쳐져 flush 되고,
+// 큐가 차면 막히지 않고 버린 수를 센다.
+static void test_queue_producers(struct pca9685 *dev)
+{
+	struct queue_producer p[QT_THREADS];
+	struct pca9685_bus *bus;
+	int i, k, rounds, ok, fail, seen, duty, want;
+
+	bus = pca9685_bus_create(&dev, 1, 100);
+	CHECK(bus != NULL, "create bus");
+	if(bus == NULL)
+		return;
+
+	// 큐 안에 다 들어가는 양: 버림 없이 채널마다 마지막 값만 남는다.
+	rounds = QUEUE_SIZE / LED_NUM / 2;
+	queue_run(bus, p, rounds);
+	CHECK(pca9685_bus_drain(bus) == 0, "drain");
+	CHECK(atomic_load(&bus->posted) == (unsigned long)rounds * LED_NUM, "posted %lu, want %d",
+			atomic_load(&bus->posted), rounds * LED_NUM);
+	CHECK(atomic_load(&bus->dropped) == 0, "dropped %lu, want 0", atomic_load(&bus->dropped));
+	CHECK(bus->coalesced == (unsigned long)(rounds - 1) * LED_NUM, "coalesced %lu, want %d",
+			bus->coalesced, (rounds - 1) * LED_NUM);
+	for(i = 0; i < QT_THREADS; i++){
+		for(k = 0; k < QT_CH; k++){
+			duty = read_duty(dev, i * QT_CH + k);
+			want = 100 + (rounds - 1) * 10 + k;
+			CHECK(duty == want, "channel %d : duty %d, want %d", i * QT_CH + k, duty, want);
+		}
+	}
+
+	// 큐보다 많이 넣는다: 비우는 쪽이 없어도 post 는 -1 로 바로 돌아오고 dropped 로 센다.
+	atomic_store(&bus->posted, 0);
+	bus->coalesced = 0;
+	rounds = QUEUE_SIZE / LED_NUM * 2;
+	queue_run(bus, p, rounds);
+	// 어느 스레드가 먼저 큐를 채울지는 정해지지 않으므로 받아들여진 채널 수를 생산자 쪽에서 센다.
+	for(i = 0, ok = 0, fail = 0, seen = 0; i < QT_THREADS; i++){
+		ok += p[i].ok;
+		fail += p[i].fail;
+		seen += p[i].ok < QT_CH ? p[i].ok : QT_CH;
+	}
+	CHECK(ok == QUEUE_SIZE, "accepted %d, want %d", ok, QUEUE_SIZE);
+	CHECK(atomic_load(&bus->posted) == QUEUE_SIZE, "posted %lu, want %d", atomic_load(&bus->posted), QUEUE_SIZE);
+	CHECK(atomic_load(&bus->dropped) == (unsigned long)fail && fail == rounds * LED_NUM - QUEUE_SIZE,
+			"dropped %lu / failed %d, want %d", atomic_load(&bus->dropped), fail, rounds * LED_NUM - QUEUE_SIZE);
+	CHECK(pca9685_bus_drain(bus) == 0, "drain");
+	CHECK(bus->coalesced == (unsigned long)(QUEUE_SIZE - seen), "coalesced %lu, want %d", bus->coalesced, QUEUE_SIZE - seen);
+
+	// 비운 뒤에는 다시 받는다.
+	CHECK(pca9685_bus_post(bus, 0, 0, 777) == 0, "post after drain");
+	CHECK(pca9685_bus_drain(bus) == 0 && read_duty(dev, 0) == 777, "channel 0 after drain : duty %d", read_duty(dev, 0));
+	pca9685_bus_destroy(bus);
+}
+
+// 밝기 최대값은 4095/4096 이 아니라 항상 켜짐(ON_H bit 4)이어야 한다.
+static void test_gamma_full_on(struct pca9685 *dev)
+{
+	uint8_t level[LED_NUM];
+	uint16_t level16[LED_NUM];
+	int on, off;
+
+	memset(level, 0, sizeof(level));
+	level[0] = 255;
+	level[1] = 254;
+	pca9685_set_brightness8(dev, level);
+	CHECK(pca9685_flush(dev) >= 0, "flush");
+	CHECK(pca9685_led_read(dev, 0, &on, &off) == 0 && (on & (LED_FULL << 8)) && !(off & (LED_FULL << 8)),
+			"level 255 : on 0x%x off 0x%x, want full on", on, off);
+	CHECK(read_duty(dev, 1) == pca9685_gamma8[254], "level 254 : duty %d, want %d", read_duty(dev, 1), pca9685_gamma8[254]);
+
+	memset(level16, 0, sizeof(level16));
+	level16[2] = 0xffff;
+	pca9685_set_brightness16(dev, level16);
+	CHECK(pca9685_flush(dev) >= 0, "flush");
+	CHECK(read_duty(dev, 2) == DUTY_FULL, "level16 0xffff : duty %d, want full on", read_duty(dev, 2));
+}
+
+int main(void)
+{
+	struct pca9685 *dev;
+
+	dev = pca9685_open(SIM_PREFIX, PCA9685_ADDR);
+	if(dev == NULL || pca9685_init(dev) < 0){
+		printf("Failed to open sim device\n");
+		return 1;
+	}
+	dev->stagger = 0;
+
+	test_anim_wide_keys(dev);
+	test_anim_full_queue(dev);
+	test_shm_keeps_other_channels(dev);
+	test_queue_producers(dev);
+	test_gamma_full_on(dev);
+	test_fleet_frequency_without_allcall();
+	test_fleet_commit_mixed_dirty();
+
+	pca9685_close(dev);
+	printf("%s\n", failed ? "FAILED" : "OK");
+	return failed != 0;
+}